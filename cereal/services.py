@@ -67,6 +67,7 @@ _services: dict[str, tuple] = {
   "modelV2": (True, 20.),
   "managerState": (True, 2., 1),
   "uploaderState": (True, 0., 1),
+  "loggerdStats": (True, 1.),
   "navInstruction": (True, 1., 10),
   "navRoute": (True, 0.),
   "navThumbnail": (True, 0.),
@@ -187,55 +187,83 @@ static uint8_t len_to_dlc(uint8_t len) {
   }
 }
 
-void Panda::pack_can_buffer(const capnp::List<cereal::CanData>::Reader &can_data_list,
-                            std::function<void(uint8_t *, size_t)> write_func) {
-  int32_t pos = 0;
-  uint8_t send_buf[2 * USB_TX_SOFT_LIMIT];
+void Panda::can_send_queue(uint32_t address, uint8_t bus, const uint8_t *dat, uint8_t len) {
+  uint8_t data_len_code = len_to_dlc(len);
+  assert(len <= 64);
+  assert(len == dlc_to_len[data_len_code]);
+
+  const uint32_t msg_size = sizeof(can_header) + len;
+  const uint32_t transfer_start = send_transfer_ends.empty() ? 0 : send_transfer_ends.back();
+  if (send_buffer.size() + msg_size - transfer_start > max_send_size) {
+    end_send_transfer();
+  }
+
+  can_header header = {};
+  header.addr = address;
+  header.extended = (address >= 0x800) ? 1 : 0;
+  header.data_len_code = data_len_code;
+  header.bus = bus - bus_offset;
+  header.checksum = 0;
+
+  const size_t pos = send_buffer.size();
+  send_buffer.resize(pos + msg_size);
+  memcpy(&send_buffer[pos], (uint8_t *)&header, sizeof(can_header));
+  memcpy(&send_buffer[pos + sizeof(can_header)], dat, len);
+
+  // set checksum
+  ((can_header *) &send_buffer[pos])->checksum = calculate_checksum(&send_buffer[pos], msg_size);
+}
+
+void Panda::end_send_transfer() {
+  const uint32_t transfer_start = send_transfer_ends.empty() ? 0 : send_transfer_ends.back();
+  if (send_buffer.size() > transfer_start) {
+    send_transfer_ends.push_back(send_buffer.size());
+  }
+}
 
+int Panda::can_send_flush() {
+  end_send_transfer();
+  uint32_t start = 0;
+  for (uint32_t end : send_transfer_ends) {
+    handle->bulk_write(3, &send_buffer[start], end - start, 5);
+    start = end;
+  }
+
+  const int transfers = send_transfer_ends.size();
+  send_buffer.clear();
+  send_transfer_ends.clear();
+  return transfers;
+}
+
+void Panda::can_send_queue(const capnp::List<cereal::CanData>::Reader &can_data_list) {
   for (const auto &cmsg : can_data_list) {
     // check if the message is intended for this panda
-    uint8_t bus = cmsg.getSrc();
-    if (bus < bus_offset || bus >= (bus_offset + PANDA_BUS_OFFSET)) {
-      continue;
-    }
-    auto can_data = cmsg.getDat();
-    uint8_t data_len_code = len_to_dlc(can_data.size());
-    assert(can_data.size() <= 64);
-    assert(can_data.size() == dlc_to_len[data_len_code]);
-
-    can_header header = {};
-    header.addr = cmsg.getAddress();
-    header.extended = (cmsg.getAddress() >= 0x800) ? 1 : 0;
-    header.data_len_code = data_len_code;
-    header.bus = bus - bus_offset;
-    header.checksum = 0;
-
-    memcpy(&send_buf[pos], (uint8_t *)&header, sizeof(can_header));
-    memcpy(&send_buf[pos + sizeof(can_header)], (uint8_t *)can_data.begin(), can_data.size());
-    uint32_t msg_size = sizeof(can_header) + can_data.size();
-
-    // set checksum
-    ((can_header *) &send_buf[pos])->checksum = calculate_checksum(&send_buf[pos], msg_size);
-
-    pos += msg_size;
-
-    if (pos >= USB_TX_SOFT_LIMIT) {
-      write_func(send_buf, pos);
-      pos = 0;
+    if (owns_bus(cmsg.getSrc())) {
+      auto can_data = cmsg.getDat();
+      can_send_queue(cmsg.getAddress(), cmsg.getSrc(), can_data.begin(), can_data.size());
     }
   }
+}
 
-  // send remaining packets
-  if (pos > 0) write_func(send_buf, pos);
+void Panda::pack_can_buffer(const capnp::List<cereal::CanData>::Reader &can_data_list,
+                            std::function<void(uint8_t *, size_t)> write_func) {
+  can_send_queue(can_data_list);
+  end_send_transfer();
+  uint32_t start = 0;
+  for (uint32_t end : send_transfer_ends) {
+    write_func(&send_buffer[start], end - start);
+    start = end;
+  }
+  send_buffer.clear();
+  send_transfer_ends.clear();
 }
 
 void Panda::can_send(const capnp::List<cereal::CanData>::Reader &can_data_list) {
-  pack_can_buffer(can_data_list, [=](uint8_t* data, size_t size) {
-    handle->bulk_write(3, data, size, 5);
-  });
+  can_send_queue(can_data_list);
+  can_send_flush();
 }
 
-bool Panda::can_receive(std::vector<can_frame>& out_vec) {
+bool Panda::can_receive(CanFrameArena &out_frames) {
   // Check if enough space left in buffer to store RECV_SIZE data
   assert(receive_buffer_size + RECV_SIZE <= sizeof(receive_buffer));
 
@@ -252,7 +280,7 @@ bool Panda::can_receive(std::vector<can_frame>& out_vec) {
   bool ret = true;
   if (recv > 0) {
     receive_buffer_size += recv;
-    ret = unpack_can_buffer(receive_buffer, receive_buffer_size, out_vec);
+    ret = unpack_can_buffer(receive_buffer, receive_buffer_size, out_frames);
   }
   return ret;
 }
@@ -261,7 +289,7 @@ void Panda::can_reset_communications() {
   handle->control_write(0xc0, 0, 0);
 }
 
-bool Panda::unpack_can_buffer(uint8_t *data, uint32_t &size, std::vector<can_frame> &out_vec) {
+bool Panda::unpack_can_buffer(uint8_t *data, uint32_t &size, CanFrameArena &out_frames) {
   int pos = 0;
 
   while (pos <= size - sizeof(can_header)) {
@@ -281,7 +309,7 @@ bool Panda::unpack_can_buffer(uint8_t *data, uint32_t &size, std::vector<can_fra
       return false;
     }
 
-    can_frame &canData = out_vec.emplace_back();
+    can_frame &canData = out_frames.emplace_back();
     canData.address = header.addr;
     canData.src = header.bus + bus_offset;
     if (header.rejected) {
@@ -291,7 +319,8 @@ bool Panda::unpack_can_buffer(uint8_t *data, uint32_t &size, std::vector<can_fra
       canData.src += CAN_RETURNED_BUS_OFFSET;
     }
 
-    canData.dat.assign((char *)&data[pos + sizeof(can_header)], data_len);
+    canData.size = data_len;
+    memcpy(canData.dat, &data[pos + sizeof(can_header)], data_len);
 
     pos += sizeof(can_header) + data_len;
   }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cassert>
 #include <cstdint>
 #include <ctime>
 #include <functional>
@@ -15,8 +16,11 @@
 #include "panda/board/can.h"
 #include "selfdrive/pandad/panda_comms.h"
 
-#define USB_TX_SOFT_LIMIT   (0x100U)
 #define USBPACKET_MAX_SIZE  (0x40)
+// a transfer that times out while the panda's buffer is full is dropped as a whole, so it is kept small.
+// SPI pandas use the same size, every transfer is one SPI transfer.
+#define USB_TX_MAX_SIZE     (0x100U)
+static_assert(USB_TX_MAX_SIZE <= SPI_BUF_SIZE - 0x40);
 
 #define RECV_SIZE (0x4000U)
 
@@ -37,16 +41,38 @@ struct __attribute__((packed)) can_header {
 };
 
 struct can_frame {
-  long address;
-  std::string dat;
-  long src;
+  uint32_t address;
+  uint8_t src;
+  uint8_t size;
+  uint8_t dat[64];
 };
 
+// upper bound of the frames unpacked by one can_receive()
+#define CAN_FRAMES_PER_RECV ((RECV_SIZE + sizeof(can_header) + 64) / sizeof(can_header))
+
+// Fixed capacity storage for the frames of a receive cycle, allocated once and reused
+class CanFrameArena {
+public:
+  CanFrameArena(size_t capacity) : frames(std::make_unique<can_frame[]>(capacity)), frames_capacity(capacity) {}
+  inline can_frame &emplace_back() {
+    assert(frames_size < frames_capacity);
+    return frames[frames_size++];
+  }
+  inline void clear() { frames_size = 0; }
+  inline size_t size() const { return frames_size; }
+  inline size_t capacity() const { return frames_capacity; }
+  inline const can_frame &operator[](size_t i) const { return frames[i]; }
+  inline const can_frame *begin() const { return frames.get(); }
+  inline const can_frame *end() const { return frames.get() + frames_size; }
 
-class Panda {
 private:
-  std::unique_ptr<PandaCommsHandle> handle;
+  std::unique_ptr<can_frame[]> frames;
+  size_t frames_size = 0;
+  const size_t frames_capacity;
+};
 
+
+class Panda {
 public:
   Panda(std::string serial="", uint32_t bus_offset=0);
 
@@ -83,17 +109,29 @@ public:
   void set_data_speed_kbps(uint16_t bus, uint16_t speed);
   void set_canfd_non_iso(uint16_t bus, bool non_iso);
   void can_send(const capnp::List<cereal::CanData>::Reader &can_data_list);
-  bool can_receive(std::vector<can_frame>& out_vec);
+  inline bool owns_bus(uint32_t bus) const { return bus >= bus_offset && bus < bus_offset + PANDA_BUS_OFFSET; }
+  // packs a frame on one of this panda's buses for the next can_send_flush()
+  void can_send_queue(uint32_t address, uint8_t bus, const uint8_t *dat, uint8_t len);
+  void can_send_queue(const capnp::List<cereal::CanData>::Reader &can_data_list);
+  // writes the queued frames in transfers of up to max_send_size bytes, returns the number of transfers
+  int can_send_flush();
+  bool can_receive(CanFrameArena &out_frames);
   void can_reset_communications();
 
 protected:
+  std::unique_ptr<PandaCommsHandle> handle;
+
   // for unit tests
   uint8_t receive_buffer[RECV_SIZE + sizeof(can_header) + 64];
   uint32_t receive_buffer_size = 0;
+  uint32_t max_send_size = USB_TX_MAX_SIZE;  // transfers only hold complete frames
+  std::vector<uint8_t> send_buffer;
+  std::vector<uint32_t> send_transfer_ends;  // in send_buffer
 
   Panda(uint32_t bus_offset) : bus_offset(bus_offset) {}
   void pack_can_buffer(const capnp::List<cereal::CanData>::Reader &can_data_list,
                          std::function<void(uint8_t *, size_t)> write_func);
-  bool unpack_can_buffer(uint8_t *data, uint32_t &size, std::vector<can_frame> &out_vec);
+  bool unpack_can_buffer(uint8_t *data, uint32_t &size, CanFrameArena &out_frames);
+  void end_send_transfer();
   uint8_t calculate_checksum(uint8_t *data, uint32_t len);
 };
@@ -5,6 +5,7 @@
 #include <bitset>
 #include <cassert>
 #include <cerrno>
+#include <cstring>
 #include <memory>
 #include <thread>
 #include <utility>
@@ -78,57 +79,231 @@ Panda *connect(std::string serial="", uint32_t index=0) {
   return panda.release();
 }
 
-void can_send_thread(std::vector<Panda *> pandas, bool fake_send) {
+CanSender::CanSender(const std::vector<Panda *> &pandas, bool fake_send) : pandas_(pandas), fake_send_(fake_send) {
+  for (auto *panda : pandas_) {
+    for (uint32_t bus = panda->bus_offset; panda->owns_bus(bus) && bus < bus_pandas_.size(); ++bus) {
+      bus_pandas_[bus] = panda;
+    }
+  }
+}
+
+void CanSender::run() {
   util::set_thread_name("pandad_can_send");
 
-  AlignedBuffer aligned_buf;
   std::unique_ptr<Context> context(Context::create());
   std::unique_ptr<SubSocket> subscriber(SubSocket::create(context.get(), "sendcan"));
   assert(subscriber != NULL);
   subscriber->setTimeout(100);
 
+  uint64_t last_log_time = nanos_since_boot();
   // run as fast as messages come in
-  while (!do_exit && check_all_connected(pandas)) {
+  while (!do_exit && check_all_connected(pandas_)) {
     std::unique_ptr<Message> msg(subscriber->receive());
     if (!msg) {
       continue;
     }
 
-    capnp::FlatArrayMessageReader cmsg(aligned_buf.align(msg.get()));
-    cereal::Event::Reader event = cmsg.getRoot<cereal::Event>();
+    // drain everything that queued up while the previous messages were written
+    uint32_t depth = 0;
+    bool queued = false;
+    do {
+      queued |= queue(msg.get());
+      ++depth;
+      msg.reset(subscriber->receive(true));
+    } while (msg);
+    stats.max_queue_depth = std::max(stats.max_queue_depth.load(), depth);
+    if (queued) {
+      flush();
+    }
 
-    // Don't send if older than 1 second
-    if ((nanos_since_boot() - event.getLogMonoTime() < 1e9) && !fake_send) {
-      for (const auto& panda : pandas) {
-        LOGT("sending sendcan to panda: %s", (panda->hw_serial()).c_str());
-        panda->can_send(event.getSendcan());
-        LOGT("sendcan sent to panda: %s", (panda->hw_serial()).c_str());
-      }
-    } else {
-      LOGE("sendcan too old to send: %" PRIu64 ", %" PRIu64, nanos_since_boot(), event.getLogMonoTime());
+    if (nanos_since_boot() - last_log_time > 10e9) {
+      const uint64_t messages = stats.messages.exchange(0);
+      LOGD("sendcan: %" PRIu64 " messages, %" PRIu64 " frames in %" PRIu64 " transfers, %" PRIu64 " dropped, "
+           "max queue depth %u, latency avg %.2f ms max %.2f ms",
+           messages, stats.frames.exchange(0), stats.transfers.exchange(0), stats.dropped.exchange(0),
+           stats.max_queue_depth.exchange(0), messages > 0 ? stats.total_latency_ns.exchange(0) / messages / 1e6 : 0.,
+           stats.max_latency_ns.exchange(0) / 1e6);
+      last_log_time = nanos_since_boot();
+    }
+  }
+}
+
+// returns false if nothing was queued
+bool CanSender::queue(Message *msg) {
+  capnp::FlatArrayMessageReader cmsg(aligned_buf_.align(msg));
+  cereal::Event::Reader event = cmsg.getRoot<cereal::Event>();
+
+  // Don't send if older than 1 second
+  if ((nanos_since_boot() - event.getLogMonoTime() >= 1e9) || fake_send_) {
+    LOGE("sendcan too old to send: %" PRIu64 ", %" PRIu64, nanos_since_boot(), event.getLogMonoTime());
+    ++stats.dropped;
+    return false;
+  }
+
+  // the frames are packed into the send buffer of their panda, in order
+  for (const auto &frame : event.getSendcan()) {
+    if (Panda *panda = frame.getSrc() < bus_pandas_.size() ? bus_pandas_[frame.getSrc()] : nullptr) {
+      auto can_data = frame.getDat();
+      panda->can_send_queue(frame.getAddress(), frame.getSrc(), can_data.begin(), can_data.size());
+      ++stats.frames;
     }
   }
+  queued_times_.push_back(event.getLogMonoTime());
+  return true;
+}
+
+void CanSender::flush() {
+  for (auto *panda : pandas_) {
+    LOGT("sending sendcan to panda: %s", (panda->hw_serial()).c_str());
+    stats.transfers += panda->can_send_flush();
+    LOGT("sendcan sent to panda: %s", (panda->hw_serial()).c_str());
+  }
+
+  const uint64_t now = nanos_since_boot();
+  for (uint64_t t : queued_times_) {
+    stats.total_latency_ns += now - t;
+    stats.max_latency_ns = std::max(stats.max_latency_ns.load(), now - t);
+  }
+  stats.messages += queued_times_.size();
+  queued_times_.clear();
+}
+
+CanReceiver::CanReceiver(const std::vector<Panda *> &pandas, bool threaded)
+    : pandas_(pandas), frames_(threaded ? 0 : pandas.size() * CAN_FRAMES_PER_RECV), buffer_(1024) {
+  if (threaded) {
+    for (auto *panda : pandas_) {
+      auto &t = threads_.emplace_back(std::make_unique<ReceiveThread>());
+      t->thread = std::thread(&CanReceiver::receiveThread, this, panda, t.get());
+    }
+    batches_.reserve(threads_.size() * 4);
+    arenas_.reserve(threads_.size() * 4);
+  }
 }
 
-void can_recv(std::vector<Panda *> &pandas, PubMaster *pm) {
-  static std::vector<can_frame> raw_can_data;
+CanReceiver::~CanReceiver() {
   {
+    std::lock_guard lk(lock_);
+    exit_ = true;
+  }
+  cycle_cv_.notify_all();
+  for (auto &t : threads_) {
+    t->thread.join();
+  }
+}
+
+void CanReceiver::receiveThread(Panda *panda, ReceiveThread *t) {
+  util::set_thread_name("pandad_can_recv");
+
+  uint64_t cycle = 0;
+  while (true) {
+    {
+      std::unique_lock lk(lock_);
+      cycle_cv_.wait(lk, [&] { return exit_ || cycle_ != cycle; });
+      if (exit_) break;
+      cycle = cycle_;
+    }
+
+    // skip the read if the publisher fell behind, the frames stay buffered in the panda
+    if (Batch *batch = t->queue.back()) {
+      batch->frames.clear();
+      batch->comms_healthy = panda->can_receive(batch->frames);
+      batch->nanos = nanos_since_boot();
+      t->queue.push();
+    }
+
+    {
+      std::lock_guard lk(lock_);
+      t->done_cycle = cycle;
+    }
+    done_cv_.notify_one();
+  }
+}
+
+void CanReceiver::receive(PubMaster *pm) {
+  if (threads_.empty()) {
     bool comms_healthy = true;
-    raw_can_data.clear();
-    for (const auto& panda : pandas) {
-      comms_healthy &= panda->can_receive(raw_can_data);
+    frames_.clear();
+    for (const auto& panda : pandas_) {
+      comms_healthy &= panda->can_receive(frames_);
     }
+    arenas_.assign(1, &frames_);
+    publish(pm, comms_healthy);
+    return;
+  }
 
-    MessageBuilder msg;
-    auto evt = msg.initEvent();
-    evt.setValid(comms_healthy);
-    auto canData = evt.initCan(raw_can_data.size());
-    for (size_t i = 0; i < raw_can_data.size(); ++i) {
-      canData[i].setAddress(raw_can_data[i].address);
-      canData[i].setDat(kj::arrayPtr((uint8_t*)raw_can_data[i].dat.data(), raw_can_data[i].dat.size()));
-      canData[i].setSrc(raw_can_data[i].src);
+  // start the reads of this cycle, and wait for them for at most half a cycle
+  {
+    std::unique_lock lk(lock_);
+    ++cycle_;
+    cycle_cv_.notify_all();
+    done_cv_.wait_for(lk, std::chrono::milliseconds(5), [this] {
+      return std::all_of(threads_.begin(), threads_.end(), [this](auto &t) { return t->done_cycle == cycle_; });
+    });
+  }
+
+  batches_.clear();
+  for (auto &t : threads_) {
+    for (size_t i = 0; Batch *batch = t->queue.front(i); ++i) {
+      batches_.push_back({batch, t.get()});
     }
-    pm->send("can", msg);
+  }
+  std::stable_sort(batches_.begin(), batches_.end(), [](auto &a, auto &b) { return a.first->nanos < b.first->nanos; });
+
+  bool comms_healthy = true;
+  arenas_.clear();
+  for (auto &[batch, t] : batches_) {
+    comms_healthy &= batch->comms_healthy;
+    arenas_.push_back(&batch->frames);
+  }
+  publish(pm, comms_healthy);
+
+  for (auto &[batch, t] : batches_) {
+    t->queue.pop();
+  }
+}
+
+void CanReceiver::publish(PubMaster *pm, bool comms_healthy) {
+  // grow the first segment to the last message that did not fit into it
+  if (message_words_ + 1 > buffer_.size()) {
+    dirty_words_ = buffer_.size() - 1;
+    buffer_.resize(message_words_ + message_words_ / 2 + 1);
+  }
+  // the builder requires a zeroed first segment
+  std::fill_n(buffer_.begin() + 1, dirty_words_, capnp::word{});
+
+  size_t num_frames = 0;
+  for (auto *frames : arenas_) {
+    num_frames += frames->size();
+  }
+
+  capnp::MallocMessageBuilder msg(kj::arrayPtr(buffer_.data() + 1, buffer_.size() - 1));
+  auto evt = msg.initRoot<cereal::Event>();
+  evt.setLogMonoTime(nanos_since_boot());
+  evt.setValid(comms_healthy);
+  auto canData = evt.initCan(num_frames);
+  size_t i = 0;
+  for (auto *frames : arenas_) {
+    for (const can_frame &frame : *frames) {
+      canData[i].setAddress(frame.address);
+      canData[i].setDat(kj::arrayPtr(frame.dat, frame.size));
+      canData[i].setSrc(frame.src);
+      ++i;
+    }
+  }
+
+  auto segments = msg.getSegmentsForOutput();
+  if (segments.size() == 1) {
+    dirty_words_ = segments[0].size();
+    message_words_ = dirty_words_;
+    // segment count - 1, segment size in words
+    const uint32_t table[2] = {0, (uint32_t)segments[0].size()};
+    memcpy(buffer_.data(), table, sizeof(table));
+    send(pm, (capnp::byte *)buffer_.data(), (segments[0].size() + 1) * sizeof(capnp::word));
+  } else {
+    dirty_words_ = buffer_.size() - 1;
+    message_words_ = capnp::computeSerializedSizeInWords(segments);
+    auto words = capnp::messageToFlatArray(segments);
+    send(pm, words.asBytes().begin(), words.asBytes().size());
   }
 }
 
@@ -419,20 +594,23 @@ void pandad_run(std::vector<Panda *> &pandas) {
   const bool no_fan_control = getenv("NO_FAN_CONTROL") != nullptr;
   const bool spoofing_started = getenv("STARTED") != nullptr;
   const bool fake_send = getenv("FAKESEND") != nullptr;
+  const bool threaded_recv = getenv("PANDAD_THREADED_RECV") != nullptr && pandas.size() > 1;
 
   // Start the CAN send thread
-  std::thread send_thread(can_send_thread, pandas, fake_send);
+  CanSender can_sender(pandas, fake_send);
+  std::thread send_thread(&CanSender::run, &can_sender);
 
   RateKeeper rk("pandad", 100);
   SubMaster sm({"selfdriveState"});
   PubMaster pm({"can", "pandaStates", "peripheralState"});
   PandaSafety panda_safety(pandas);
+  CanReceiver can_receiver(pandas, threaded_recv);
   Panda *peripheral_panda = pandas[0];
   bool engaged = false;
 
   // Main loop: receive CAN data and process states
   while (!do_exit && check_all_connected(pandas)) {
-    can_recv(pandas, &pm);
+    can_receiver.receive(&pm);
 
     // Process peripheral state at 20 Hz
     if (rk.frame() % 5 == 0) {
@@ -1,8 +1,16 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
+#include "cereal/messaging/messaging.h"
 #include "common/params.h"
 #include "selfdrive/pandad/panda.h"
 
@@ -25,3 +33,103 @@ private:
   std::vector<Panda *> pandas_;
   Params params_;
 };
+
+// Sends sendcan to the pandas. Every wakeup drains all pending messages, hands each frame to the
+// panda that owns its bus, and then writes the frames of each panda in as few transfers as possible.
+class CanSender {
+public:
+  struct Stats {
+    std::atomic<uint64_t> messages = 0;
+    std::atomic<uint64_t> frames = 0;           // handed to a panda
+    std::atomic<uint64_t> transfers = 0;
+    std::atomic<uint64_t> dropped = 0;          // messages older than 1 second
+    std::atomic<uint32_t> max_queue_depth = 0;  // messages drained at once
+    std::atomic<uint64_t> total_latency_ns = 0; // from logMonoTime until written
+    std::atomic<uint64_t> max_latency_ns = 0;
+  };
+
+  CanSender(const std::vector<Panda *> &pandas, bool fake_send);
+  // until exit or a panda disconnects
+  void run();
+  Stats stats;
+
+protected:
+  // for unit tests
+  bool queue(Message *msg);
+  void flush();
+
+private:
+  std::vector<Panda *> pandas_;
+  std::array<Panda *, 256> bus_pandas_ = {};  // by bus
+  const bool fake_send_;
+  AlignedBuffer aligned_buf_;
+  std::vector<uint64_t> queued_times_;  // logMonoTime of the queued messages
+};
+
+// Lock-free ring of preallocated items between one producer and one consumer thread
+template <class T, size_t N>
+class SpscQueue {
+public:
+  // producer: the item to fill before push(), nullptr if the queue is full
+  T *back() {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    return head - tail_.load(std::memory_order_acquire) == N ? nullptr : &items_[head % N];
+  }
+  void push() { head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+  // consumer: the oldest item, nullptr if the queue is empty
+  T *front(size_t i = 0) {
+    const size_t tail = tail_.load(std::memory_order_relaxed) + i;
+    return tail == head_.load(std::memory_order_acquire) ? nullptr : &items_[tail % N];
+  }
+  void pop(size_t n = 1) { tail_.store(tail_.load(std::memory_order_relaxed) + n, std::memory_order_release); }
+
+private:
+  std::array<T, N> items_;
+  alignas(64) std::atomic<size_t> head_ = 0;
+  alignas(64) std::atomic<size_t> tail_ = 0;
+};
+
+// Publishes the frames received from all pandas as a can message. The frames are unpacked into
+// arenas, and the message is built in a reused first segment preceded by its segment table, so it
+// is sent without a copy and the steady state does not allocate.
+// In threaded mode every panda is read on its own thread, the reads of a cycle overlap instead of
+// running one after another. A read that is still in flight when the cycle is published goes out
+// with the next one, the batches are published in the order they were received.
+class CanReceiver {
+public:
+  CanReceiver(const std::vector<Panda *> &pandas, bool threaded = false);
+  virtual ~CanReceiver();
+  void receive(PubMaster *pm);
+
+protected:
+  // for unit tests
+  virtual void send(PubMaster *pm, capnp::byte *data, size_t size) { pm->send("can", data, size); }
+
+private:
+  struct Batch {
+    uint64_t nanos = 0;  // when the read returned
+    bool comms_healthy = true;
+    CanFrameArena frames{CAN_FRAMES_PER_RECV};
+  };
+  struct ReceiveThread {
+    SpscQueue<Batch, 4> queue;
+    uint64_t done_cycle = 0;
+    std::thread thread;
+  };
+  void receiveThread(Panda *panda, ReceiveThread *t);
+  void publish(PubMaster *pm, bool comms_healthy);
+
+  std::vector<Panda *> pandas_;
+  CanFrameArena frames_;
+  std::vector<const CanFrameArena *> arenas_;  // in publishing order
+  std::vector<capnp::word> buffer_;  // word 0 is the segment table
+  size_t dirty_words_ = 0;  // of the first segment, zeroed before it is reused
+  size_t message_words_ = 0;
+
+  std::vector<std::unique_ptr<ReceiveThread>> threads_;
+  std::vector<std::pair<Batch *, ReceiveThread *>> batches_;
+  std::mutex lock_;
+  std::condition_variable cycle_cv_, done_cv_;
+  uint64_t cycle_ = 0;
+  bool exit_ = false;
+};
@@ -0,0 +1,299 @@
+#define CATCH_CONFIG_MAIN
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "cereal/messaging/messaging.h"
+#include "common/timing.h"
+#include "selfdrive/pandad/pandad.h"
+
+// records the transfers written to a panda, and serves its reads
+class FakeHandle : public PandaCommsHandle {
+public:
+  FakeHandle() : PandaCommsHandle("") {}
+  void cleanup() override {}
+  int control_write(uint8_t request, uint16_t param1, uint16_t param2, unsigned int timeout) override { return 0; }
+  int control_read(uint8_t request, uint16_t param1, uint16_t param2, unsigned char *data, uint16_t length, unsigned int timeout) override { return 0; }
+  int bulk_write(unsigned char endpoint, unsigned char *data, int length, unsigned int timeout) override {
+    writes.emplace_back(data, data + length);
+    return length;
+  }
+  int bulk_read(unsigned char endpoint, unsigned char *data, int length, unsigned int timeout) override {
+    return read ? read(data, length) : 0;
+  }
+
+  std::vector<std::vector<uint8_t>> writes;
+  std::function<int(unsigned char *data, int length)> read;
+};
+
+struct PandaTest : public Panda {
+  PandaTest(uint32_t bus_offset) : Panda(bus_offset) {
+    handle = std::make_unique<FakeHandle>();
+  }
+  FakeHandle &fake() { return *(FakeHandle *)handle.get(); }
+
+  // a frame as the panda sends it
+  std::vector<uint8_t> packed_frame(uint32_t address, uint8_t bus) {
+    const uint8_t dat[8] = {};
+    can_send_queue(address, bus, dat, sizeof(dat));
+    std::vector<uint8_t> data;
+    data.swap(send_buffer);
+    send_transfer_ends.clear();
+    return data;
+  }
+
+  // the frames of all written transfers, in order
+  std::vector<can_frame> written_frames() {
+    CanFrameArena frames(CAN_FRAMES_PER_RECV);
+    for (auto &w : fake().writes) {
+      REQUIRE(w.size() <= max_send_size);
+      uint32_t size = w.size();
+      REQUIRE(unpack_can_buffer(w.data(), size, frames));
+      REQUIRE(size == 0);  // transfers hold complete frames
+    }
+    return {frames.begin(), frames.end()};
+  }
+};
+
+struct CanSenderTest : public CanSender {
+  using CanSender::CanSender;
+  using CanSender::queue;
+  using CanSender::flush;
+};
+
+class TestMessage : public Message {
+public:
+  TestMessage(kj::ArrayPtr<capnp::byte> bytes) : data_(bytes.begin(), bytes.end()) {}
+  void init(size_t size) override { data_.resize(size); }
+  void init(char *data, size_t size) override { data_.assign(data, data + size); }
+  void close() override { data_.clear(); }
+  size_t getSize() override { return data_.size(); }
+  char *getData() override { return data_.data(); }
+
+private:
+  std::vector<char> data_;
+};
+
+using Frame = std::tuple<uint32_t, uint8_t, std::string>;  // address, bus, data
+
+TestMessage sendcan_message(uint64_t log_mono_time, const std::vector<Frame> &frames) {
+  MessageBuilder msg;
+  auto event = msg.initEvent();
+  event.setLogMonoTime(log_mono_time);
+  auto can_list = event.initSendcan(frames.size());
+  for (int i = 0; i < frames.size(); ++i) {
+    auto &[address, bus, dat] = frames[i];
+    can_list[i].setAddress(address);
+    can_list[i].setSrc(bus);
+    can_list[i].setDat(kj::ArrayPtr((const uint8_t *)dat.data(), dat.size()));
+  }
+  return TestMessage(msg.toBytes());
+}
+
+TEST_CASE("CanSender routes frames to the panda of their bus") {
+  PandaTest panda0(0), panda1(PANDA_BUS_OFFSET);
+  CanSenderTest sender({&panda0, &panda1}, false);
+
+  std::vector<Frame> expected[2];
+  const uint64_t now = nanos_since_boot();
+  for (int m = 0; m < 10; ++m) {
+    std::vector<Frame> frames;
+    for (uint32_t i = 0; i < 20; ++i) {
+      // the buses of both pandas, and one no panda owns
+      const uint8_t bus = std::vector<uint8_t>{0, 2, PANDA_BUS_OFFSET, PANDA_BUS_OFFSET + 1, 2 * PANDA_BUS_OFFSET}[i % 5];
+      frames.emplace_back(m * 100 + i, bus, std::string(8, (char)i));
+      if (bus < 2 * PANDA_BUS_OFFSET) {
+        expected[bus / PANDA_BUS_OFFSET].push_back(frames.back());
+      }
+    }
+    TestMessage msg = sendcan_message(now, frames);
+    REQUIRE(sender.queue(&msg));
+  }
+  // older than 1 second
+  TestMessage old_msg = sendcan_message(now - 2e9, {{1, 0, "old"}});
+  REQUIRE_FALSE(sender.queue(&old_msg));
+  sender.flush();
+
+  PandaTest *pandas[] = {&panda0, &panda1};
+  size_t transfers = 0;
+  for (int p = 0; p < 2; ++p) {
+    auto frames = pandas[p]->written_frames();
+    REQUIRE(frames.size() == expected[p].size());
+    for (int i = 0; i < frames.size(); ++i) {
+      auto &[address, bus, dat] = expected[p][i];
+      REQUIRE(frames[i].address == address);
+      REQUIRE(frames[i].src == bus);
+      REQUIRE(std::string((char *)frames[i].dat, frames[i].size) == dat);
+    }
+    // the frames of all messages are batched into full transfers
+    const size_t frames_per_transfer = USB_TX_MAX_SIZE / (sizeof(can_header) + 8);
+    REQUIRE(pandas[p]->fake().writes.size() == (frames.size() + frames_per_transfer - 1) / frames_per_transfer);
+    transfers += pandas[p]->fake().writes.size();
+  }
+
+  REQUIRE(sender.stats.messages == 10);
+  REQUIRE(sender.stats.frames == expected[0].size() + expected[1].size());
+  REQUIRE(sender.stats.transfers == transfers);
+  REQUIRE(sender.stats.dropped == 1);
+}
+
+TEST_CASE("sendcan transfers are small over SPI too") {
+  PandaTest panda(0);
+  // CAN FD frames, three fit into a transfer
+  const uint8_t dat[64] = {};
+  for (uint32_t i = 0; i < 100; ++i) {
+    panda.can_send_queue(i, i % 3, dat, sizeof(dat));
+  }
+  REQUIRE(panda.can_send_flush() == 34);
+
+  // as PandaSpiHandle::bulk_transfer splits the writes
+  const int spi_xfer_size = SPI_BUF_SIZE - 0x40;
+  for (auto &w : panda.fake().writes) {
+    REQUIRE(w.size() <= USB_TX_MAX_SIZE);
+    REQUIRE(w.size() <= spi_xfer_size);
+  }
+  auto frames = panda.written_frames();
+  REQUIRE(frames.size() == 100);
+  for (uint32_t i = 0; i < frames.size(); ++i) {
+    REQUIRE(frames[i].address == i);
+  }
+}
+
+TEST_CASE("SpscQueue") {
+  SpscQueue<int, 4> queue;
+  REQUIRE(queue.front() == nullptr);
+
+  // around the ring a few times, with the queue full and empty in between
+  int pushed = 0, popped = 0;
+  for (int lap = 0; lap < 5; ++lap) {
+    for (int i = 0; i < 4; ++i) {
+      int *item = queue.back();
+      REQUIRE(item != nullptr);
+      *item = pushed++;
+      queue.push();
+    }
+    REQUIRE(queue.back() == nullptr);
+
+    for (int i = 0; i < 4; ++i) {
+      REQUIRE(*queue.front(i) == popped + i);
+    }
+    REQUIRE(queue.front(4) == nullptr);
+    // pop a part, the freed items are reused
+    queue.pop(lap % 4 + 1);
+    popped += lap % 4 + 1;
+    for (int i = 0; i < lap % 4 + 1; ++i) {
+      *queue.back() = pushed++;
+      queue.push();
+    }
+    REQUIRE(queue.back() == nullptr);
+    while (int *item = queue.front()) {
+      REQUIRE(*item == popped++);
+      queue.pop();
+    }
+    REQUIRE(popped == pushed);
+  }
+
+  SECTION("between threads") {
+    SpscQueue<std::array<int, 16>, 4> queue;
+    const int count = 10000;
+    std::thread producer([&]() {
+      for (int i = 0; i < count; /**/) {
+        if (auto *item = queue.back()) {
+          item->fill(i++);
+          queue.push();
+        }
+      }
+    });
+    for (int expected = 0; expected < count; /**/) {
+      size_t n = 0;
+      for (; auto *item = queue.front(n); ++n, ++expected) {
+        REQUIRE(std::count(item->begin(), item->end(), expected) == item->size());
+      }
+      queue.pop(n);
+    }
+    producer.join();
+  }
+}
+
+struct CanReceiverTest : public CanReceiver {
+  using CanReceiver::CanReceiver;
+  void send(PubMaster *pm, capnp::byte *data, size_t size) override {
+    auto &words = messages.emplace_back(size / sizeof(capnp::word));
+    memcpy(words.data(), data, size);
+  }
+
+  // address and bus of the frames of each published message
+  std::vector<std::vector<std::pair<uint32_t, uint8_t>>> published_frames() {
+    std::vector<std::vector<std::pair<uint32_t, uint8_t>>> published;
+    for (auto &words : messages) {
+      capnp::FlatArrayMessageReader reader(kj::ArrayPtr<const capnp::word>(words.data(), words.size()));
+      auto &frames = published.emplace_back();
+      for (const auto &frame : reader.getRoot<cereal::Event>().getCan()) {
+        frames.emplace_back(frame.getAddress(), frame.getSrc());
+      }
+    }
+    return published;
+  }
+
+  std::vector<std::vector<capnp::word>> messages;
+};
+
+TEST_CASE("CanReceiver publishes late reads with the next cycle") {
+  PandaTest panda0(0), panda1(PANDA_BUS_OFFSET);
+  std::atomic<uint32_t> reads[2] = {};
+  std::promise<void> release;
+  std::shared_future<void> released = release.get_future().share();
+  PandaTest *pandas[] = {&panda0, &panda1};
+  for (int p = 0; p < 2; ++p) {
+    pandas[p]->fake().read = [=, &reads](unsigned char *data, int length) {
+      const uint32_t n = reads[p]++;
+      // the first read of panda1 is still in flight when the first cycle is published
+      if (p == 1 && n == 0) released.wait();
+      // one frame per read, addressed by the read
+      auto frame = pandas[p]->packed_frame(n, pandas[p]->bus_offset);
+      memcpy(data, frame.data(), frame.size());
+      return (int)frame.size();
+    };
+  }
+
+  CanReceiverTest receiver({&panda0, &panda1}, true);
+  receiver.receive(nullptr);
+  // the late read returns before the next cycle starts
+  release.set_value();
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  for (int i = 0; i < 10; ++i) {
+    receiver.receive(nullptr);
+  }
+
+  auto published = receiver.published_frames();
+  REQUIRE(published.size() == 11);
+  // nothing of panda1 goes out with the first cycle
+  for (auto &[address, bus] : published[0]) {
+    REQUIRE(bus == 0);
+  }
+  // its late read goes out with the next cycle, before the reads of that cycle
+  using PublishedFrame = std::pair<uint32_t, uint8_t>;
+  auto late = std::find(published[1].begin(), published[1].end(), PublishedFrame{0, PANDA_BUS_OFFSET});
+  REQUIRE(late != published[1].end());
+  REQUIRE(std::all_of(published[1].begin(), late, [](auto &f) { return f == PublishedFrame{0, 0}; }));
+
+  // every read is published once, in the order of each panda's reads
+  std::vector<uint32_t> next_read(2, 0);
+  for (auto &frames : published) {
+    for (auto &[address, bus] : frames) {
+      REQUIRE(address == next_read[bus / PANDA_BUS_OFFSET]++);
+    }
+  }
+  // the last reads may still be in flight
+  REQUIRE(next_read[0] + 1 >= reads[0]);
+  REQUIRE(next_read[1] + 1 >= reads[1]);
+}
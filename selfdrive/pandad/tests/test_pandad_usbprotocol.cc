@@ -52,6 +52,7 @@ PandaTest::PandaTest(uint32_t bus_offset_, int can_list_size, cereal::PandaState
 void PandaTest::test_can_send() {
   std::vector<uint8_t> unpacked_data;
   this->pack_can_buffer(can_data_list, [&](uint8_t *chunk, size_t size) {
+    REQUIRE(size <= this->max_send_size);
     unpacked_data.insert(unpacked_data.end(), chunk, &chunk[size]);
   });
   REQUIRE(unpacked_data.size() == total_pakets_size);
@@ -74,7 +75,7 @@ void PandaTest::test_can_send() {
 }
 
 void PandaTest::test_can_recv(uint32_t rx_chunk_size) {
-  std::vector<can_frame> frames;
+  CanFrameArena frames(can_list_size);
   this->pack_can_buffer(can_data_list, [&](uint8_t *data, uint32_t size) {
     if (rx_chunk_size == 0) {
       REQUIRE(this->unpack_can_buffer(data, size, frames));
@@ -96,9 +97,9 @@ void PandaTest::test_can_recv(uint32_t rx_chunk_size) {
   REQUIRE(frames.size() == can_list_size);
   for (int i = 0; i < frames.size(); ++i) {
     REQUIRE(frames[i].address == i);
-    REQUIRE(test_data.find(frames[i].dat.size()) != test_data.end());
-    const std::string &dat = test_data[frames[i].dat.size()];
-    REQUIRE(memcmp(dat.data(), frames[i].dat.data(), dat.size()) == 0);
+    REQUIRE(test_data.find(frames[i].size) != test_data.end());
+    const std::string &dat = test_data[frames[i].size];
+    REQUIRE(memcmp(dat.data(), frames[i].dat, dat.size()) == 0);
   }
 }
 
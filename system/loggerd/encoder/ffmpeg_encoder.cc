@@ -11,8 +11,6 @@
 
 #define __STDC_CONSTANT_MACROS
 
-#include "third_party/libyuv/include/libyuv.h"
-
 extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
@@ -24,8 +22,8 @@ extern "C" {
 
 const int env_debug_encoder = (getenv("DEBUG_ENCODER") != NULL) ? atoi(getenv("DEBUG_ENCODER")) : 0;
 
-FfmpegEncoder::FfmpegEncoder(const EncoderInfo &encoder_info, int in_width, int in_height)
-    : VideoEncoder(encoder_info, in_width, in_height) {
+FfmpegEncoder::FfmpegEncoder(const EncoderInfo &encoder_info, int in_width, int in_height, FrameConverter *converter)
+    : VideoEncoder(encoder_info, in_width, in_height), converter(converter) {
   frame = av_frame_alloc();
   assert(frame);
   frame->format = AV_PIX_FMT_YUV420P;
@@ -35,11 +33,11 @@ FfmpegEncoder::FfmpegEncoder(const EncoderInfo &encoder_info, int in_width, int
   frame->linesize[1] = out_width/2;
   frame->linesize[2] = out_width/2;
 
-  convert_buf.resize(in_width * in_height * 3 / 2);
-
-  if (in_width != out_width || in_height != out_height) {
-    downscale_buf.resize(out_width * out_height * 3 / 2);
+  if (!converter) {
+    own_converter = std::make_unique<FrameConverter>(in_width, in_height);
+    this->converter = own_converter.get();
   }
+  size_id = this->converter->addSize(out_width, out_height);
 }
 
 FfmpegEncoder::~FfmpegEncoder() {
@@ -78,37 +76,14 @@ int FfmpegEncoder::encode_frame(VisionBuf* buf, VisionIpcBufExtra *extra) {
   assert(buf->width == this->in_width);
   assert(buf->height == this->in_height);
 
-  uint8_t *cy = convert_buf.data();
-  uint8_t *cu = cy + in_width * in_height;
-  uint8_t *cv = cu + (in_width / 2) * (in_height / 2);
-  libyuv::NV12ToI420(buf->y, buf->stride,
-                     buf->uv, buf->stride,
-                     cy, in_width,
-                     cu, in_width/2,
-                     cv, in_width/2,
-                     in_width, in_height);
-
-  if (downscale_buf.size() > 0) {
-    uint8_t *out_y = downscale_buf.data();
-    uint8_t *out_u = out_y + frame->width * frame->height;
-    uint8_t *out_v = out_u + (frame->width / 2) * (frame->height / 2);
-    libyuv::I420Scale(cy, in_width,
-                      cu, in_width/2,
-                      cv, in_width/2,
-                      in_width, in_height,
-                      out_y, frame->width,
-                      out_u, frame->width/2,
-                      out_v, frame->width/2,
-                      frame->width, frame->height,
-                      libyuv::kFilterNone);
-    frame->data[0] = out_y;
-    frame->data[1] = out_u;
-    frame->data[2] = out_v;
-  } else {
-    frame->data[0] = cy;
-    frame->data[1] = cu;
-    frame->data[2] = cv;
+  if (own_converter) {
+    own_converter->setFrame(buf);
   }
+  // shared with the other encoders of the camera, the encoder only reads the planes
+  const I420Frame &img = converter->get(size_id);
+  frame->data[0] = (uint8_t *)img.y;
+  frame->data[1] = (uint8_t *)img.u;
+  frame->data[2] = (uint8_t *)img.v;
   frame->pts = counter*50*1000; // 50ms per frame
 
   int ret = counter;
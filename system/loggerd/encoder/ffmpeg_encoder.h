@@ -2,8 +2,8 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <memory>
 #include <string>
-#include <vector>
 
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -12,11 +12,13 @@ extern "C" {
 }
 
 #include "system/loggerd/encoder/encoder.h"
+#include "system/loggerd/encoder/frame_converter.h"
 #include "system/loggerd/loggerd.h"
 
 class FfmpegEncoder : public VideoEncoder {
 public:
-  FfmpegEncoder(const EncoderInfo &encoder_info, int in_width, int in_height);
+  // frames are taken from converter after the caller sets them, or converted by the encoder without one
+  FfmpegEncoder(const EncoderInfo &encoder_info, int in_width, int in_height, FrameConverter *converter = nullptr);
   ~FfmpegEncoder();
   int encode_frame(VisionBuf* buf, VisionIpcBufExtra *extra);
   void encoder_open();
@@ -29,6 +31,7 @@ private:
 
   AVCodecContext *codec_ctx;
   AVFrame *frame = NULL;
-  std::vector<uint8_t> convert_buf;
-  std::vector<uint8_t> downscale_buf;
+  std::unique_ptr<FrameConverter> own_converter;
+  FrameConverter *converter;
+  int size_id;
 };
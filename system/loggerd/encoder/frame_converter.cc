@@ -0,0 +1,66 @@
+#include "system/loggerd/encoder/frame_converter.h"
+
+#include <cassert>
+
+#include "third_party/libyuv/include/libyuv.h"
+
+FrameConverter::FrameConverter(int width, int height) {
+  addSize(width, height);
+}
+
+int FrameConverter::addSize(int width, int height) {
+  for (int i = 0; i < converted_.size(); ++i) {
+    if (converted_[i]->image.width == width && converted_[i]->image.height == height) return i;
+  }
+
+  auto &img = converted_.emplace_back(std::make_unique<Converted>());
+  img->image.width = width;
+  img->image.height = height;
+  return converted_.size() - 1;
+}
+
+void FrameConverter::setFrame(VisionBuf *buf) {
+  assert(buf->width == converted_[0]->image.width && buf->height == converted_[0]->image.height);
+  buf_ = buf;
+  ++frame_;
+}
+
+const I420Frame &FrameConverter::get(int id) {
+  Converted &img = *converted_[id];
+  std::lock_guard lk(img.lock);
+  if (img.frame == frame_) return img.image;
+
+  I420Frame &dst = img.image;
+  if (img.buffer.empty()) {
+    // the height is padded to 16 rows, the jpeg encoder reads whole blocks of rows
+    img.buffer.resize(dst.width * ((dst.height + 15) & ~15) * 3 / 2);
+    dst.y = img.buffer.data();
+    dst.u = img.buffer.data() + dst.width * dst.height;
+    dst.v = img.buffer.data() + dst.width * dst.height + (dst.width / 2) * (dst.height / 2);
+    if (id != 0) img.uv.resize(dst.width * (dst.height / 2));
+  }
+
+  if (id == 0) {
+    libyuv::NV12ToI420(buf_->y, buf_->stride,
+                       buf_->uv, buf_->stride,
+                       (uint8_t *)dst.y, dst.width,
+                       (uint8_t *)dst.u, dst.width / 2,
+                       (uint8_t *)dst.v, dst.width / 2,
+                       dst.width, dst.height);
+  } else {
+    // same as I420Scale() of the full size. without filtering the UV pairs scale as 16-bit pixels
+    const int src_width = buf_->width, src_height = buf_->height;
+    libyuv::ScalePlane(buf_->y, buf_->stride, src_width, src_height,
+                       (uint8_t *)dst.y, dst.width, dst.width, dst.height,
+                       libyuv::kFilterNone);
+    libyuv::ScalePlane_16((const uint16_t *)buf_->uv, buf_->stride / 2, src_width / 2, src_height / 2,
+                          (uint16_t *)img.uv.data(), dst.width / 2, dst.width / 2, dst.height / 2,
+                          libyuv::kFilterNone);
+    libyuv::SplitUVPlane(img.uv.data(), dst.width,
+                         (uint8_t *)dst.u, dst.width / 2,
+                         (uint8_t *)dst.v, dst.width / 2,
+                         dst.width / 2, dst.height / 2);
+  }
+  img.frame = frame_;
+  return img.image;
+}
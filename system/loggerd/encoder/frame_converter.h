@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "msgq/visionipc/visionbuf.h"
+
+// I420 image with packed planes, the strides are width and width / 2
+struct I420Frame {
+  const uint8_t *y = nullptr, *u = nullptr, *v = nullptr;
+  int width = 0, height = 0;
+};
+
+// Converts the NV12 frames of a camera to I420 and scales them to the sizes its encoders need,
+// once per frame. A size is converted by the first encoder that asks for it and shared with the
+// others until the next frame, encoders on other threads wait for it instead of converting again.
+// Scaled sizes are scaled from the NV12 frame, the buffer of a size is allocated when it is first
+// converted, so a camera of which only the thumbnail is converted doesn't hold a full size image.
+class FrameConverter {
+public:
+  FrameConverter(int width, int height);
+  // returns the id of the size, not thread safe
+  int addSize(int width, int height);
+  // the converted images are invalid after the next frame
+  void setFrame(VisionBuf *buf);
+  const I420Frame &get(int id);
+
+private:
+  struct Converted {
+    std::mutex lock;
+    uint64_t frame = 0;  // setFrame() count of the converted frame
+    std::vector<uint8_t> buffer;
+    std::vector<uint8_t> uv;  // scaled interleaved UV of scaled sizes
+    I420Frame image;
+  };
+
+  VisionBuf *buf_ = nullptr;
+  uint64_t frame_ = 0;
+  std::vector<std::unique_ptr<Converted>> converted_;  // by size id, 0 is the full size
+};
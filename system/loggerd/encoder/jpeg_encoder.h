@@ -9,21 +9,21 @@
 #include <memory>
 #include "cereal/messaging/messaging.h"
 #include "msgq/visionipc/visionbuf.h"
+#include "system/loggerd/encoder/frame_converter.h"
 
 class JpegEncoder {
 public:
   JpegEncoder(const std::string &pusblish_name, int width, int height);
   ~JpegEncoder();
-  void pushThumbnail(VisionBuf *buf, const VisionIpcBufExtra &extra);
+  // the image is the thumbnail size, with rows up to a multiple of 16 readable
+  void pushThumbnail(const I420Frame &img, const VisionIpcBufExtra &extra);
 
 private:
-  void generateThumbnail(const uint8_t *y, const uint8_t *uv, int width, int height, int stride);
-  void compressToJpeg(uint8_t *y_plane, uint8_t *u_plane, uint8_t *v_plane);
+  void compressToJpeg(const uint8_t *y_plane, const uint8_t *u_plane, const uint8_t *v_plane);
 
   int thumbnail_width;
   int thumbnail_height;
   std::string publish_name;
-  std::vector<uint8_t> yuv_buffer;
   std::unique_ptr<PubMaster> pm;
 
   // JPEG output buffer
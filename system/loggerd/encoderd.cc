@@ -1,6 +1,12 @@
 #include <cassert>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
 
 #include "system/loggerd/loggerd.h"
+#include "system/loggerd/encoder/frame_converter.h"
 #include "system/loggerd/encoder/jpeg_encoder.h"
 
 #ifdef QCOM2
@@ -13,6 +19,9 @@
 
 ExitHandler do_exit;
 
+// encode the frames of a camera on one thread per encoder, the device pins encoderd to one core
+const bool ENCODERD_PARALLEL = util::getenv("ENCODERD_PARALLEL", Hardware::PC() ? 1 : 0);
+
 struct EncoderdState {
   int max_waiting = 0;
 
@@ -44,14 +53,108 @@ bool sync_encoders(EncoderdState *s, VisionStreamType cam_type, uint32_t frame_i
   }
 }
 
+// Runs every job of a frame on its own thread. The VisionBuf is shared by reference, and run()
+// returns once all jobs are done with it, before the next frame is received.
+class FrameWorkers {
+public:
+  struct Job {
+    std::string name;
+    std::function<void(VisionBuf *buf, VisionIpcBufExtra *extra)> run;
+  };
+
+  FrameWorkers(std::vector<Job> jobs) : jobs_(std::move(jobs)) {
+    for (int i = 0; i < jobs_.size(); ++i) {
+      threads_.emplace_back(&FrameWorkers::workerThread, this, i);
+    }
+  }
+
+  ~FrameWorkers() {
+    {
+      std::lock_guard lk(lock_);
+      exit_ = true;
+    }
+    frame_cv_.notify_all();
+    for (auto &t : threads_) t.join();
+  }
+
+  void run(VisionBuf *buf, const VisionIpcBufExtra &extra) {
+    {
+      std::lock_guard lk(lock_);
+      buf_ = buf;
+      extra_ = extra;
+      pending_ = jobs_.size();
+      ++frame_;
+    }
+    frame_cv_.notify_all();
+
+    std::unique_lock lk(lock_);
+    done_cv_.wait(lk, [this]() { return pending_ == 0; });
+  }
+
+private:
+  void workerThread(int i) {
+    util::set_thread_name(jobs_[i].name.c_str());
+    uint64_t frame = 0;
+    while (true) {
+      VisionBuf *buf = nullptr;
+      VisionIpcBufExtra extra;
+      {
+        std::unique_lock lk(lock_);
+        frame_cv_.wait(lk, [&]() { return exit_ || frame_ != frame; });
+        if (exit_) break;
+
+        frame = frame_;
+        buf = buf_;
+        extra = extra_;  // each job gets its own copy
+      }
+
+      jobs_[i].run(buf, &extra);
+
+      bool done = false;
+      {
+        std::lock_guard lk(lock_);
+        done = --pending_ == 0;
+      }
+      if (done) done_cv_.notify_one();
+    }
+  }
+
+  const std::vector<Job> jobs_;
+  std::vector<std::thread> threads_;
+  std::mutex lock_;
+  std::condition_variable frame_cv_, done_cv_;
+  VisionBuf *buf_ = nullptr;
+  VisionIpcBufExtra extra_ = {};
+  uint64_t frame_ = 0;
+  int pending_ = 0;
+  bool exit_ = false;
+};
+
+void run_encoder(VideoEncoder *encoder, VisionBuf *buf, VisionIpcBufExtra *extra) {
+  int out_id = encoder->encode_frame(buf, extra);
+
+  if (out_id == -1) {
+    LOGE("Failed to encode frame. frame_id: %d", extra->frame_id);
+  }
+}
+
+void push_thumbnail(JpegEncoder *jpeg_encoder, FrameConverter *converter, int size_id, const VisionIpcBufExtra &extra) {
+  if (extra.frame_id % 1200 == 100) {
+    jpeg_encoder->pushThumbnail(converter->get(size_id), extra);
+  }
+}
 
 void encoder_thread(EncoderdState *s, const LogCameraInfo &cam_info) {
   util::set_thread_name(cam_info.thread_name);
 
+  // the I420 frames shared by the encoders of the camera
+  std::unique_ptr<FrameConverter> converter;
   std::vector<std::unique_ptr<Encoder>> encoders;
   VisionIpcClient vipc_client = VisionIpcClient("camerad", cam_info.stream_type, false);
 
   std::unique_ptr<JpegEncoder> jpeg_encoder;
+  int thumbnail_size = -1;
+  std::unique_ptr<FrameWorkers> workers;  // uses the encoders, destroyed before them
 
   int cur_seg = 0;
   while (!do_exit) {
@@ -66,14 +169,36 @@ void encoder_thread(EncoderdState *s, const LogCameraInfo &cam_info) {
       LOGW("encoder %s init %zux%zu", cam_info.thread_name, buf_info.width, buf_info.height);
       assert(buf_info.width > 0 && buf_info.height > 0);
 
+      converter = std::make_unique<FrameConverter>(buf_info.width, buf_info.height);
       for (const auto &encoder_info : cam_info.encoder_infos) {
+#ifdef QCOM2
+        // the hardware encoder reads the NV12 buffer
         auto &e = encoders.emplace_back(new Encoder(encoder_info, buf_info.width, buf_info.height));
+#else
+        auto &e = encoders.emplace_back(new Encoder(encoder_info, buf_info.width, buf_info.height, converter.get()));
+#endif
         e->encoder_open();
       }
 
       // Only one thumbnail can be generated per camera stream
       if (auto thumbnail_name = cam_info.encoder_infos[0].thumbnail_name) {
         jpeg_encoder = std::make_unique<JpegEncoder>(thumbnail_name, buf_info.width / 4, buf_info.height / 4);
+        thumbnail_size = converter->addSize(buf_info.width / 4, buf_info.height / 4);
+      }
+
+      if (ENCODERD_PARALLEL && encoders.size() + (jpeg_encoder ? 1 : 0) > 1) {
+        std::vector<FrameWorkers::Job> jobs;
+        for (int i = 0; i < encoders.size(); ++i) {
+          jobs.push_back({cam_info.encoder_infos[i].publish_name, [e = encoders[i].get()](VisionBuf *buf, VisionIpcBufExtra *extra) {
+            run_encoder(e, buf, extra);
+          }});
+        }
+        if (jpeg_encoder) {
+          jobs.push_back({cam_info.encoder_infos[0].thumbnail_name, [j = jpeg_encoder.get(), c = converter.get(), id = thumbnail_size](VisionBuf *buf, VisionIpcBufExtra *extra) {
+            push_thumbnail(j, c, id, *extra);
+          }});
+        }
+        workers = std::make_unique<FrameWorkers>(std::move(jobs));
       }
     }
 
@@ -109,16 +234,21 @@ void encoder_thread(EncoderdState *s, const LogCameraInfo &cam_info) {
       }
 
       // encode a frame
-      for (int i = 0; i < encoders.size(); ++i) {
-        int out_id = encoders[i]->encode_frame(buf, &extra);
-
-        if (out_id == -1) {
-          LOGE("Failed to encode frame. frame_id: %d", extra.frame_id);
+      converter->setFrame(buf);
+      if (workers) {
+        workers->run(buf, extra);
+      } else {
+        for (auto &e : encoders) {
+          run_encoder(e.get(), buf, &extra);
+        }
+        if (jpeg_encoder) {
+          push_thumbnail(jpeg_encoder.get(), converter.get(), thumbnail_size, extra);
         }
       }
 
-      if (jpeg_encoder && (extra.frame_id % 1200 == 100)) {
-        jpeg_encoder->pushThumbnail(buf, extra);
+      // camerad reuses the buffer after cycling through all of them, which must not happen while it is encoded
+      if (buf->get_frame_id() != extra.frame_id) {
+        LOGE("encoder %s buffer of frame %d was reused while encoding", cam_info.thread_name, extra.frame_id);
       }
     }
   }
@@ -165,11 +165,25 @@ LoggerState::LoggerState(const std::string &log_root) {
   route_name = logger_get_identifier("RouteCount");
   route_path = log_root + "/" + route_name;
   init_data = logger_build_init_data();
+  if (LOG_COMPRESSION_WORKERS > 0) {
+    compress_pool = std::make_shared<ZstdCompressPool>(LOG_COMPRESSION_WORKERS);
+  }
 }
 
 LoggerState::~LoggerState() {
   if (rlog) {
     log_sentinel(this, SentinelType::END_OF_ROUTE, exit_signal);
+    closeSegment();
+  }
+}
+
+void LoggerState::closeSegment() {
+  rlog.reset();
+  qlog.reset();
+  if (compress_pool) {
+    // keep the segment locked until the pool has written out its last frames
+    compress_pool->post([lock = lock_file]() { std::remove(lock.c_str()); });
+  } else {
     std::remove(lock_file.c_str());
   }
 }
@@ -177,7 +191,7 @@ LoggerState::~LoggerState() {
 bool LoggerState::next() {
   if (rlog) {
     log_sentinel(this, SentinelType::END_OF_SEGMENT);
-    std::remove(lock_file.c_str());
+    closeSegment();
   }
 
   segment_path = route_path + "--" + std::to_string(++part);
@@ -187,8 +201,8 @@ bool LoggerState::next() {
   lock_file = segment_path + "/rlog.lock";
   std::ofstream{lock_file};
 
-  rlog.reset(new ZstdFileWriter(segment_path + "/rlog.zst", LOG_COMPRESSION_LEVEL));
-  qlog.reset(new ZstdFileWriter(segment_path + "/qlog.zst", LOG_COMPRESSION_LEVEL));
+  rlog.reset(new ZstdFileWriter(segment_path + "/rlog.zst", LOG_COMPRESSION_LEVEL, compress_pool, true));
+  qlog.reset(new ZstdFileWriter(segment_path + "/qlog.zst", LOG_COMPRESSION_LEVEL, compress_pool, true));
 
   // log init data & sentinel type.
   write(init_data.asBytes(), true);
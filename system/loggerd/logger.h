@@ -10,6 +10,8 @@
 #include "system/loggerd/zstd_writer.h"
 
 constexpr int LOG_COMPRESSION_LEVEL = 10;
+// rlog/qlog are compressed as independent frames on this many threads, 0 compresses and writes inline
+const int LOG_COMPRESSION_WORKERS = util::getenv("LOGGERD_COMPRESSION_WORKERS", 1);
 
 typedef cereal::Sentinel::SentinelType SentinelType;
 
@@ -24,11 +26,15 @@ public:
   inline const std::string& routeName() const { return route_name; }
   inline void write(kj::ArrayPtr<kj::byte> bytes, bool in_qlog) { write(bytes.begin(), bytes.size(), in_qlog); }
   inline void setExitSignal(int signal) { exit_signal = signal; }
+  inline ZstdCompressPool *compressPool() const { return compress_pool.get(); }
 
 protected:
+  void closeSegment();
+
   int part = -1, exit_signal = 0;
   std::string route_path, route_name, segment_path, lock_file;
   kj::Array<capnp::word> init_data;
+  std::shared_ptr<ZstdCompressPool> compress_pool;  // must outlive rlog and qlog
   std::unique_ptr<ZstdFileWriter> rlog, qlog;
 };
 
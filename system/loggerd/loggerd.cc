@@ -1,24 +1,106 @@
 #include <sys/xattr.h>
 
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
 #include "common/params.h"
 #include "system/loggerd/encoder/encoder.h"
 #include "system/loggerd/loggerd.h"
+#include "system/loggerd/mpsc_ring.h"
 #include "system/loggerd/video_writer.h"
 
 ExitHandler do_exit;
 
+// Builds the *EncodeIdx events in a reused first segment and writes it to the logs directly,
+// instead of a new MessageBuilder and flat array copy for every video packet.
+class EncodeIdxWriter {
+public:
+  size_t write(LoggerState &logger, cereal::Event::Reader event, cereal::EncodeIndex::Reader idx, const EncoderInfo &encoder_info) {
+    // the builder requires a zeroed first segment
+    std::fill_n(buffer_.begin() + 1, dirty_words_, capnp::word{});
+
+    capnp::MallocMessageBuilder msg(kj::arrayPtr(buffer_.data() + 1, buffer_.size() - 1));
+    auto evt = msg.initRoot<cereal::Event>();
+    evt.setLogMonoTime(event.getLogMonoTime());
+    evt.setValid(event.getValid());
+    (evt.*(encoder_info.set_encode_idx_func))(idx);
+
+    auto segments = msg.getSegmentsForOutput();
+    if (segments.size() != 1) {
+      // never expected, the event is a fraction of the first segment
+      dirty_words_ = buffer_.size() - 1;
+      auto words = capnp::messageToFlatArray(segments);
+      logger.write(words.asBytes(), true);
+      return words.asBytes().size();
+    }
+    dirty_words_ = segments[0].size();
+    // segment count - 1, segment size in words
+    const uint32_t table[2] = {0, (uint32_t)segments[0].size()};
+    memcpy(buffer_.data(), table, sizeof(table));
+    const size_t size = (segments[0].size() + 1) * sizeof(capnp::word);
+    logger.write((uint8_t *)buffer_.data(), size, true);  // always in qlog?
+    return size;
+  }
+
+private:
+  std::array<capnp::word, 64> buffer_ = {};  // word 0 is the segment table
+  size_t dirty_words_ = 0;  // of the first segment, zeroed before it is reused
+};
+
 struct LoggerdState {
   LoggerState logger;
   std::atomic<double> last_camera_seen_tms{0.0};
   std::atomic<int> ready_to_rotate{0};  // count of encoders ready to rotate
   int max_waiting = 0;
-  double last_rotate_tms = 0.;      // last rotate time in ms
+  std::atomic<double> last_rotate_tms{0.};  // last rotate time in ms
+  std::atomic<int> segment{-1};             // logger.segment() for the receive stage
+  std::atomic<uint32_t> encoder_queued{0};  // packets of the next segment waiting for the rotation
+  std::atomic<uint64_t> encoder_dropped{0};
+  EncodeIdxWriter idx_writer;  // log stage only
+};
+
+struct ServiceState {
+  std::string name;
+  int counter, freq;
+  bool encoder, user_flag;
+};
+
+// The receive stage drains the sockets into the ring, the log stage writes the messages and video
+// packets, and compression and the rlog/qlog file writes run on the ZstdCompressPool threads.
+// A stalled write fills the ring instead of blocking the sockets, and the messages that don't fit
+// are dropped and counted.
+struct LogItem {
+  Message *msg = nullptr;  // nullptr rotates if the logger is still on rotate_segment
+  ServiceState *service = nullptr;
+  bool in_qlog = false;
+  int rotate_segment = -1;
+};
+
+struct LogQueue {
+  MpscRing<LogItem> ring{LOG_QUEUE_SIZE};
+  std::mutex lock;
+  std::condition_variable cv;
+  std::atomic<bool> consumer_waiting = false;
+  std::atomic<bool> receiving = true;
+
+  bool push(const LogItem &item) {
+    if (!ring.push(item)) return false;
+    if (consumer_waiting) {
+      std::lock_guard lk(lock);
+      cv.notify_one();
+    }
+    return true;
+  }
 };
 
 void logger_rotate(LoggerdState *s) {
@@ -26,38 +108,40 @@ void logger_rotate(LoggerdState *s) {
   assert(ret);
   s->ready_to_rotate = 0;
   s->last_rotate_tms = millis_since_boot();
+  s->segment = s->logger.segment();
   LOGW((s->logger.segment() == 0) ? "logging to %s" : "rotated to %s", s->logger.segmentPath().c_str());
 }
 
-void rotate_if_needed(LoggerdState *s) {
-  // all encoders ready, trigger rotation
-  bool all_ready = s->ready_to_rotate == s->max_waiting;
-
-  // fallback logic to prevent extremely long segments in the case of camera, encoder, etc. malfunctions
-  bool timed_out = false;
+// fallback logic to prevent extremely long segments in the case of camera, encoder, etc. malfunctions
+bool rotation_timed_out(LoggerdState *s) {
   double tms = millis_since_boot();
   double seg_length_secs = (tms - s->last_rotate_tms) / 1000.;
   if ((seg_length_secs > SEGMENT_LENGTH) && !LOGGERD_TEST) {
     // TODO: might be nice to put these reasons in the sentinel
     if ((tms - s->last_camera_seen_tms) > NO_CAMERA_PATIENCE) {
-      timed_out = true;
       LOGE("no camera packets seen. auto rotating");
+      return true;
     } else if (seg_length_secs > SEGMENT_LENGTH*1.2) {
-      timed_out = true;
       LOGE("segment too long. auto rotating");
+      return true;
     }
   }
-
-  if (all_ready || timed_out) {
-    logger_rotate(s);
-  }
+  return false;
 }
 
+// an encoder packet, parsed once when it is received
+struct EncoderPacket {
+  EncoderPacket(Message *msg) : msg(msg), reader({(capnp::word *)msg->getData(), msg->getSize() / sizeof(capnp::word)}) {}
+  ~EncoderPacket() { delete msg; }
+  Message *msg;
+  capnp::FlatArrayMessageReader reader;
+};
+
 struct RemoteEncoder {
   std::unique_ptr<VideoWriter> writer;
   int encoderd_segment_offset;
   int current_segment = -1;
-  std::vector<Message *> q;
+  std::deque<EncoderPacket> q;  // packets of the next segment, and the packet being handled at the back
   int dropped_frames = 0;
   bool recording = false;
   bool marked_ready_to_rotate = false;
@@ -107,21 +191,14 @@ size_t write_encode_data(LoggerdState *s, cereal::Event::Reader event, RemoteEnc
   }
 
   // put it in log stream as the idx packet
-  MessageBuilder bmsg;
-  auto evt = bmsg.initEvent(event.getValid());
-  evt.setLogMonoTime(event.getLogMonoTime());
-  (evt.*(encoder_info.set_encode_idx_func))(idx);
-  auto new_msg = bmsg.toBytes();
-  s->logger.write((uint8_t *)new_msg.begin(), new_msg.size(), true);  // always in qlog?
-  return new_msg.size();
+  return s->idx_writer.write(s->logger, event, idx, encoder_info);
 }
 
 int handle_encoder_msg(LoggerdState *s, Message *msg, std::string &name, struct RemoteEncoder &re, const EncoderInfo &encoder_info) {
   int bytes_count = 0;
 
-  // extract the message
-  capnp::FlatArrayMessageReader cmsg(kj::ArrayPtr<capnp::word>((capnp::word *)msg->getData(), msg->getSize() / sizeof(capnp::word)));
-  auto event = cmsg.getRoot<cereal::Event>();
+  // extract the message, it stays in the queue if it belongs to the next segment
+  auto event = re.q.emplace_back(msg).reader.getRoot<cereal::Event>();
   auto edata = (event.*(encoder_info.get_encode_data_func))();
   auto idx = edata.getIdx();
 
@@ -145,17 +222,14 @@ int handle_encoder_msg(LoggerdState *s, Message *msg, std::string &name, struct
       re.current_segment = s->logger.segment();
       re.marked_ready_to_rotate = false;
       // we are in this segment now, process any queued messages before this one
-      if (!re.q.empty()) {
-        for (auto qmsg : re.q) {
-          capnp::FlatArrayMessageReader reader({(capnp::word *)qmsg->getData(), qmsg->getSize() / sizeof(capnp::word)});
-          bytes_count += write_encode_data(s, reader.getRoot<cereal::Event>(), re, encoder_info);
-          delete qmsg;
-        }
-        re.q.clear();
+      s->encoder_queued -= re.q.size() - 1;
+      while (re.q.size() > 1) {
+        bytes_count += write_encode_data(s, re.q.front().reader.getRoot<cereal::Event>(), re, encoder_info);
+        re.q.pop_front();
       }
     }
     bytes_count += write_encode_data(s, event, re, encoder_info);
-    delete msg;
+    re.q.pop_back();
   } else if (offset_segment_num > s->logger.segment()) {
     // encoderd packet has a newer segment, this means encoderd has rolled over
     if (!re.marked_ready_to_rotate) {
@@ -167,12 +241,13 @@ int handle_encoder_msg(LoggerdState *s, Message *msg, std::string &name, struct
     }
 
     // TODO: define this behavior, but for now don't leak
-    if (re.q.size() > MAIN_FPS*10) {
+    if (re.q.size() > MAIN_FPS*10 + 1) {
       LOGE_100("%s: dropping frame, queue is too large", name.c_str());
-      delete msg;
+      ++s->encoder_dropped;
+      re.q.pop_back();
     } else {
       // queue up all the new segment messages, they go in after the rotate
-      re.q.push_back(msg);
+      ++s->encoder_queued;
     }
   } else {
     LOGE("%s: encoderd packet has a older segment!!! idx.getSegmentNum():%d s->logger.segment():%d re.encoderd_segment_offset:%d",
@@ -180,7 +255,7 @@ int handle_encoder_msg(LoggerdState *s, Message *msg, std::string &name, struct
     // free the message, it's useless. this should never happen
     // actually, this can happen if you restart encoderd
     re.encoderd_segment_offset = -s->logger.segment();
-    delete msg;
+    re.q.pop_back();
   }
 
   return bytes_count;
@@ -209,18 +284,86 @@ void handle_user_flag(LoggerdState *s) {
   prev_segment = s->logger.segment();
 }
 
+void log_thread(LoggerdState *s, LogQueue *queue) {
+  std::unordered_map<ServiceState *, struct RemoteEncoder> remote_encoders;
+  std::map<std::string, EncoderInfo> encoder_infos_dict;
+  for (const auto &cam : cameras_logged) {
+    for (const auto &encoder_info : cam.encoder_infos) {
+      encoder_infos_dict[encoder_info.publish_name] = encoder_info;
+    }
+  }
+
+  LogItem item;
+  while (true) {
+    if (!queue->ring.pop(item)) {
+      if (queue->receiving) {
+        std::unique_lock lk(queue->lock);
+        queue->consumer_waiting = true;
+        queue->cv.wait_for(lk, std::chrono::milliseconds(10), [&]() { return queue->ring.size() > 0 || !queue->receiving; });
+        queue->consumer_waiting = false;
+        continue;
+      }
+      // the receive stage may have pushed its last items before it stopped
+      if (!queue->ring.pop(item)) break;
+    }
+
+    if (!item.msg) {
+      // the receive stage timed out this segment, unless the encoders rotated it already
+      if (item.rotate_segment == s->logger.segment()) {
+        logger_rotate(s);
+      }
+      continue;
+    }
+
+    ServiceState *service = item.service;
+    if (service->user_flag) {
+      handle_user_flag(s);
+    }
+    if (service->encoder) {
+      handle_encoder_msg(s, item.msg, service->name, remote_encoders[service], encoder_infos_dict[service->name]);
+    } else {
+      s->logger.write((uint8_t *)item.msg->getData(), item.msg->getSize(), item.in_qlog);
+      delete item.msg;
+    }
+
+    // all encoders ready, trigger rotation
+    if (s->ready_to_rotate == s->max_waiting) {
+      logger_rotate(s);
+    }
+  }
+}
+
+struct StageDepth {
+  size_t depth = 0, max_depth = 0;
+  void update(size_t d) {
+    depth = d;
+    max_depth = std::max(max_depth, d);
+  }
+};
+
+void publish_stats(PubMaster &pm, uint64_t msg_count, uint64_t bytes_count, const std::vector<std::pair<const char *, StageDepth>> &stages,
+                   const std::vector<uint64_t> &dropped) {
+  MessageBuilder msg;
+  auto stats = msg.initEvent().initLoggerdStats();
+  stats.setMessagesReceived(msg_count);
+  stats.setBytesReceived(bytes_count);
+  auto lst = stats.initStages(stages.size());
+  for (int i = 0; i < stages.size(); ++i) {
+    lst[i].setName(stages[i].first);
+    lst[i].setQueueDepth(stages[i].second.depth);
+    lst[i].setMaxQueueDepth(stages[i].second.max_depth);
+    lst[i].setDropped(dropped[i]);
+  }
+  pm.send("loggerdStats", msg);
+}
+
 void loggerd_thread() {
   // setup messaging
-  typedef struct ServiceState {
-    std::string name;
-    int counter, freq;
-    bool encoder, user_flag;
-  } ServiceState;
   std::unordered_map<SubSocket*, ServiceState> service_state;
-  std::unordered_map<SubSocket*, struct RemoteEncoder> remote_encoders;
 
   std::unique_ptr<Context> ctx(Context::create());
   std::unique_ptr<Poller> poller(Poller::create());
+  PubMaster pm({"loggerdStats"});
 
   // subscribe to all socks
   for (const auto& [_, it] : services) {
@@ -246,25 +389,24 @@ void loggerd_thread() {
   logger_rotate(&s);
   Params().put("CurrentRoute", s.logger.routeName());
 
-  std::map<std::string, EncoderInfo> encoder_infos_dict;
   for (const auto &cam : cameras_logged) {
-    for (const auto &encoder_info : cam.encoder_infos) {
-      encoder_infos_dict[encoder_info.publish_name] = encoder_info;
-      s.max_waiting++;
-    }
+    s.max_waiting += cam.encoder_infos.size();
   }
 
-  uint64_t msg_count = 0, bytes_count = 0;
+  LogQueue queue;
+  std::thread writer(log_thread, &s, &queue);
+
+  StageDepth receive_depth, encoder_depth, compress_depth, write_depth;
+  uint64_t msg_count = 0, bytes_count = 0, receive_dropped = 0, write_dropped = 0;
+  int rotate_requested = -1;
   double start_ts = millis_since_boot();
+  double last_stats_tms = start_ts;
   while (!do_exit) {
     // poll for new messages on all sockets
-    for (auto sock : poller->poll(1000)) {
+    for (auto sock : poller->poll(100)) {
       if (do_exit) break;
 
       ServiceState &service = service_state[sock];
-      if (service.user_flag) {
-        handle_user_flag(&s);
-      }
 
       // drain socket
       int count = 0;
@@ -273,15 +415,14 @@ void loggerd_thread() {
         const bool in_qlog = service.freq != -1 && (service.counter++ % service.freq == 0);
         if (service.encoder) {
           s.last_camera_seen_tms = millis_since_boot();
-          bytes_count += handle_encoder_msg(&s, msg, service.name, remote_encoders[sock], encoder_infos_dict[service.name]);
-        } else {
-          s.logger.write((uint8_t *)msg->getData(), msg->getSize(), in_qlog);
-          bytes_count += msg->getSize();
+        }
+        bytes_count += msg->getSize();
+        if (!queue.push({.msg = msg, .service = &service, .in_qlog = in_qlog})) {
+          LOGE_100("log queue is full, dropping '%s'", service.name.c_str());
+          ++receive_dropped;
           delete msg;
         }
 
-        rotate_if_needed(&s);
-
         if ((++msg_count % 10000) == 0) {
           double seconds = (millis_since_boot() - start_ts) / 1000.0;
           LOGD("%" PRIu64 " messages, %.2f msg/sec, %.2f KB/sec", msg_count, msg_count / seconds, bytes_count * 0.001 / seconds);
@@ -294,8 +435,37 @@ void loggerd_thread() {
         }
       }
     }
+
+    // the marker is retried on the next loop if the ring is full
+    const int segment = s.segment;
+    if (segment != rotate_requested && rotation_timed_out(&s) && queue.push({.rotate_segment = segment})) {
+      rotate_requested = segment;
+    }
+
+    receive_depth.update(queue.ring.size());
+    encoder_depth.update(s.encoder_queued);
+    if (auto pool = s.logger.compressPool()) {
+      size_t to_compress, to_write;
+      pool->queueDepths(to_compress, to_write);
+      compress_depth.update(to_compress);
+      write_depth.update(to_write);
+      write_dropped = pool->writeDropped();
+    }
+
+    const double tms = millis_since_boot();
+    if (tms - last_stats_tms >= 1000.) {
+      publish_stats(pm, msg_count, bytes_count,
+                    {{"receive", receive_depth}, {"encoder", encoder_depth}, {"compress", compress_depth}, {"write", write_depth}},
+                    {receive_dropped, s.encoder_dropped, 0, write_dropped});
+      receive_depth = encoder_depth = compress_depth = write_depth = {};
+      last_stats_tms = tms;
+    }
   }
 
+  // the log stage writes what is left in the ring before the logger closes
+  queue.receiving = false;
+  writer.join();
+
   LOGW("closing logger");
   s.logger.setExitSignal(do_exit.signal);
 
@@ -18,6 +18,7 @@ const int LIVESTREAM_BITRATE = 1e6;
 const int QCAM_BITRATE = 256000;
 
 #define NO_CAMERA_PATIENCE 500  // fall back to time-based rotation if all cameras are dead
+const int LOG_QUEUE_SIZE = 1 << 15;  // messages between the receive and log stages
 
 #define INIT_ENCODE_FUNCTIONS(encode_type)                                \
   .get_encode_data_func = &cereal::Event::Reader::get##encode_type##Data, \
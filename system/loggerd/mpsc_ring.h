@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Bounded lock-free queue for any number of producers and a single consumer. Each slot has a
+// sequence number that tells whether it is free for the producer at head, or filled for the consumer.
+template <class T>
+class MpscRing {
+public:
+  // capacity must be a power of two
+  MpscRing(size_t capacity) : slots_(std::make_unique<Slot[]>(capacity)), mask_(capacity - 1) {
+    assert(capacity > 0 && (capacity & mask_) == 0);
+    for (size_t i = 0; i < capacity; ++i) {
+      slots_[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  // returns false if the ring is full
+  bool push(T item) {
+    size_t pos = head_.load(std::memory_order_relaxed);
+    while (true) {
+      Slot &slot = slots_[pos & mask_];
+      const intptr_t diff = (intptr_t)slot.seq.load(std::memory_order_acquire) - (intptr_t)pos;
+      if (diff == 0) {
+        if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          slot.item = std::move(item);
+          slot.seq.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = head_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // consumer only, returns false if the ring is empty
+  bool pop(T &item) {
+    const size_t pos = tail_.load(std::memory_order_relaxed);
+    Slot &slot = slots_[pos & mask_];
+    if (slot.seq.load(std::memory_order_acquire) != pos + 1) {
+      return false;
+    }
+    item = std::move(slot.item);
+    slot.seq.store(pos + mask_ + 1, std::memory_order_release);
+    tail_.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // approximate while items are pushed or popped
+  size_t size() const {
+    const size_t tail = tail_.load(std::memory_order_acquire);
+    const size_t head = head_.load(std::memory_order_acquire);
+    return head > tail ? head - tail : 0;
+  }
+  size_t capacity() const { return mask_ + 1; }
+
+private:
+  struct Slot {
+    std::atomic<size_t> seq;
+    T item;
+  };
+  std::unique_ptr<Slot[]> slots_;
+  const size_t mask_;
+  alignas(64) std::atomic<size_t> head_ = 0;  // next slot for the producers
+  alignas(64) std::atomic<size_t> tail_ = 0;  // next slot for the consumer
+};
@@ -0,0 +1,206 @@
+#include "system/loggerd/segment_file.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "common/swaglog.h"
+#include "common/timing.h"
+
+namespace {
+
+std::mutex sizes_lock;
+std::map<std::string, size_t> last_sizes;  // final size of the last closed file, by file name
+
+}  // namespace
+
+// Writes back the data of the open segment files
+class SegmentFileSyncer {
+public:
+  static SegmentFileSyncer &instance() {
+    static SegmentFileSyncer syncer;
+    return syncer;
+  }
+
+  void add(SegmentFile *file) {
+    std::lock_guard lk(lock_);
+    files_.insert(file);
+  }
+
+  // the file is not accessed anymore once this returns. only waits for a sync of this file.
+  void remove(SegmentFile *file) {
+    std::unique_lock lk(lock_);
+    files_.erase(file);
+    synced_cv_.wait(lk, [file]() { return !file->syncing_; });
+  }
+
+private:
+  SegmentFileSyncer() : thread_(&SegmentFileSyncer::syncThread, this) {}
+  ~SegmentFileSyncer() {
+    {
+      std::lock_guard lk(lock_);
+      exit_ = true;
+    }
+    cv_.notify_one();
+    thread_.join();
+  }
+
+  void syncThread() {
+    util::set_thread_name("loggerd_sync");
+    std::unique_lock lk(lock_);
+    while (!cv_.wait_for(lk, std::chrono::milliseconds(LOG_SYNC_INTERVAL_MS / 2), [this]() { return exit_; })) {
+      // files are synced without the lock, so opening and closing files doesn't wait for the disk
+      const std::vector<SegmentFile *> files(files_.begin(), files_.end());
+      for (SegmentFile *file : files) {
+        if (files_.count(file) == 0) continue;  // closed meanwhile
+
+        const int fd = file->fd_;
+        const size_t synced = file->synced_;
+        const size_t written = file->written_;
+        if (written == synced) continue;
+
+        file->syncing_ = true;
+        lk.unlock();
+#ifdef __APPLE__
+        fsync(fd);
+#else
+        int ret = sync_file_range(fd, synced, written - synced,
+                                  SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        if (ret != 0) LOGW("sync_file_range failed: %s", strerror(errno));
+        // the data is on disk, it won't be read again
+        posix_fadvise(fd, synced, written - synced, POSIX_FADV_DONTNEED);
+#endif
+        lk.lock();
+        file->synced_ = written;
+        file->syncing_ = false;
+        synced_cv_.notify_all();
+      }
+    }
+  }
+
+  std::mutex lock_;
+  std::condition_variable cv_, synced_cv_;
+  std::set<SegmentFile *> files_;
+  bool exit_ = false;
+  std::thread thread_;
+};
+
+// class SegmentFile
+
+SegmentFile::SegmentFile(const std::string &path) : name_(path.substr(path.rfind('/') + 1)) {
+  const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+#ifndef __APPLE__
+  if (LOG_DIRECT_IO) {
+    // not every filesystem supports it
+    fd_ = HANDLE_EINTR(open(path.c_str(), flags | O_DIRECT, 0666));
+    direct_ = fd_ >= 0;
+  }
+#endif
+  if (fd_ < 0) {
+    fd_ = HANDLE_EINTR(open(path.c_str(), flags, 0666));
+  }
+  assert(fd_ >= 0);
+
+#ifndef __APPLE__
+  size_t prealloc_size = 0;
+  {
+    std::lock_guard lk(sizes_lock);
+    auto it = last_sizes.find(name_);
+    if (it != last_sizes.end()) prealloc_size = it->second;
+  }
+  // the file size stays at the written data, the unused space is released on close
+  if (prealloc_size > 0 && fallocate(fd_, FALLOC_FL_KEEP_SIZE, 0, prealloc_size) != 0) {
+    LOGD("fallocate %s failed: %s", path.c_str(), strerror(errno));
+  }
+#endif
+
+  buffer_ = (char *)aligned_alloc(PAGE_SIZE, CHUNK_SIZE);
+  assert(buffer_);
+
+  if (LOG_SYNC_INTERVAL_MS > 0) {
+    SegmentFileSyncer::instance().add(this);
+  }
+}
+
+SegmentFile::~SegmentFile() {
+  if (LOG_SYNC_INTERVAL_MS > 0) {
+    SegmentFileSyncer::instance().remove(this);
+  }
+
+  if (buffered_ > 0) {
+#ifndef __APPLE__
+    if (direct_) {
+      // the tail is not a multiple of the page size
+      fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) & ~O_DIRECT);
+    }
+#endif
+    writeOut(buffered_);
+  }
+#ifndef __APPLE__
+  if (HANDLE_EINTR(ftruncate(fd_, written_)) != 0) {
+    LOGW("ftruncate %s failed: %s", name_.c_str(), strerror(errno));
+  }
+#endif
+  {
+    std::lock_guard lk(sizes_lock);
+    last_sizes[name_] = written_;
+  }
+
+  int err = close(fd_);
+  assert(err == 0);
+  free(buffer_);
+}
+
+bool SegmentFile::write(const void *data, size_t size) {
+  const char *p = (const char *)data;
+  while (size > 0) {
+    if (buffered_ == 0) {
+      buffered_tms_ = millis_since_boot();
+    }
+    const size_t n = std::min(size, CHUNK_SIZE - buffered_);
+    memcpy(buffer_ + buffered_, p, n);
+    buffered_ += n;
+    p += n;
+    size -= n;
+    if (buffered_ == CHUNK_SIZE) {
+      writeOut(CHUNK_SIZE);
+    }
+  }
+
+  // bound the time data stays in the buffer, only writing whole pages keeps the writes aligned
+  if (LOG_SYNC_INTERVAL_MS > 0 && buffered_ >= PAGE_SIZE && millis_since_boot() - buffered_tms_ > LOG_SYNC_INTERVAL_MS / 2) {
+    writeOut(buffered_ - buffered_ % PAGE_SIZE);
+  }
+  return ok_;
+}
+
+// writes the first size bytes of the buffer
+bool SegmentFile::writeOut(size_t size) {
+  size_t done = 0;
+  while (done < size) {
+    ssize_t n = HANDLE_EINTR(pwrite(fd_, buffer_ + done, size - done, written_ + done));
+    if (n <= 0) {
+      LOGE("failed to write %s: %s", name_.c_str(), strerror(errno));
+      ok_ = false;
+      break;
+    }
+    done += n;
+  }
+
+  written_ += size;
+  buffered_ -= size;
+  memmove(buffer_, buffer_ + size, buffered_);
+  buffered_tms_ = millis_since_boot();
+  return ok_;
+}
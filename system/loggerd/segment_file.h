@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+
+#include "common/util.h"
+
+// data written out of the buffer is written back to disk within about this many ms, 0 leaves it to the kernel
+const int LOG_SYNC_INTERVAL_MS = util::getenv("LOGGERD_SYNC_INTERVAL_MS", 1000);
+// write segment files with O_DIRECT, bypassing the page cache
+const bool LOG_DIRECT_IO = util::getenv("LOGGERD_DIRECT_IO", 0);
+
+// Writes a segment file in large page-aligned writes. The space for as much data as the previous
+// segment's file of the same name is allocated when the file is opened. A background thread
+// writes back the data with sync_file_range() every LOG_SYNC_INTERVAL_MS / 2 and drops it from the
+// page cache, so dirty pages don't pile up into writeback spikes.
+// The buffer is only written out by write() and on close: whole pages once the oldest buffered data
+// is older than LOG_SYNC_INTERVAL_MS / 2, the last partial page on close. A crash loses what is still
+// buffered, the last partial page and the data of the last LOG_SYNC_INTERVAL_MS / 2 while the file
+// is being written, everything since the last write() of an idle file.
+class SegmentFile {
+public:
+  SegmentFile(const std::string &path);
+  ~SegmentFile();
+  // returns false if the file or a previous write failed
+  bool write(const void *data, size_t size);
+  size_t size() const { return written_ + buffered_; }
+
+  static constexpr size_t CHUNK_SIZE = 1024 * 1024;
+  static constexpr size_t PAGE_SIZE = 4096;
+
+private:
+  friend class SegmentFileSyncer;
+  bool writeOut(size_t size);
+
+  std::string name_;  // the preallocation is sized by file name
+  int fd_ = -1;
+  bool direct_ = false;
+  bool ok_ = true;
+  char *buffer_ = nullptr;  // CHUNK_SIZE, page aligned
+  size_t buffered_ = 0;
+  double buffered_tms_ = 0;  // when the oldest buffered data was written
+  std::atomic<size_t> written_ = 0;
+  size_t synced_ = 0;     // by the syncer thread
+  bool syncing_ = false;  // guarded by the syncer's lock, the fd is in use
+};
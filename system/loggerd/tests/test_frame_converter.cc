@@ -0,0 +1,73 @@
+#include <catch2/catch.hpp>
+#include <cstring>
+#include <vector>
+
+#include "system/loggerd/encoder/frame_converter.h"
+#include "third_party/libyuv/include/libyuv.h"
+
+TEST_CASE("FrameConverter converts each size once per frame", "[FrameConverter]") {
+  const int width = 64, height = 48, stride = 80;
+  const int small_width = 16, small_height = 12;
+  std::vector<uint8_t> nv12(stride * height * 3 / 2);
+  VisionBuf buf = {};
+  buf.width = width;
+  buf.height = height;
+  buf.stride = stride;
+  buf.y = nv12.data();
+  buf.uv = nv12.data() + stride * height;
+  auto fill = [&](int seed) {
+    for (int i = 0; i < nv12.size(); ++i) nv12[i] = (i * 7 + seed) % 251;
+  };
+  auto copy = [](const I420Frame &img) {
+    std::vector<uint8_t> planes(img.y, img.y + img.width * img.height);
+    planes.insert(planes.end(), img.u, img.u + img.width / 2 * img.height / 2);
+    planes.insert(planes.end(), img.v, img.v + img.width / 2 * img.height / 2);
+    return planes;
+  };
+
+  FrameConverter converter(width, height);
+  REQUIRE(converter.addSize(width, height) == 0);
+  const int small = converter.addSize(small_width, small_height);
+  REQUIRE(small == 1);
+  REQUIRE(converter.addSize(small_width, small_height) == small);
+  // only converts the thumbnail, without the full size
+  FrameConverter thumbnail_converter(width, height);
+  const int thumbnail = thumbnail_converter.addSize(small_width, small_height);
+
+  for (int seed : {1, 2}) {
+    fill(seed);
+    converter.setFrame(&buf);
+    thumbnail_converter.setFrame(&buf);
+
+    const I420Frame &full = converter.get(0);
+    REQUIRE(full.width == width);
+    REQUIRE(full.height == height);
+    for (int r = 0; r < height; ++r) {
+      REQUIRE(memcmp(full.y + r * width, buf.y + r * stride, width) == 0);
+    }
+    for (int r = 0; r < height / 2; ++r) {
+      for (int c = 0; c < width / 2; ++c) {
+        REQUIRE(full.u[r * width / 2 + c] == buf.uv[r * stride + c * 2]);
+        REQUIRE(full.v[r * width / 2 + c] == buf.uv[r * stride + c * 2 + 1]);
+      }
+    }
+
+    // same as scaling the full size
+    std::vector<uint8_t> expected(small_width * small_height * 3 / 2);
+    uint8_t *y = expected.data(), *u = y + small_width * small_height, *v = u + small_width / 2 * small_height / 2;
+    libyuv::I420Scale(full.y, width, full.u, width / 2, full.v, width / 2, width, height,
+                      y, small_width, u, small_width / 2, v, small_width / 2, small_width, small_height, libyuv::kFilterNone);
+    const I420Frame &scaled = converter.get(small);
+    REQUIRE(scaled.width == small_width);
+    REQUIRE(scaled.height == small_height);
+    REQUIRE(copy(scaled) == expected);
+    REQUIRE(copy(thumbnail_converter.get(thumbnail)) == expected);
+
+    // the converted images are kept until the next frame
+    const auto full_planes = copy(full), scaled_planes = copy(scaled);
+    fill(seed + 100);
+    REQUIRE(&converter.get(0) == &full);
+    REQUIRE(copy(converter.get(0)) == full_planes);
+    REQUIRE(copy(converter.get(small)) == scaled_planes);
+  }
+}
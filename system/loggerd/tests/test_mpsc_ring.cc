@@ -0,0 +1,53 @@
+#include <catch2/catch.hpp>
+#include <thread>
+#include <vector>
+
+#include "system/loggerd/mpsc_ring.h"
+
+TEST_CASE("MpscRing rejects items when full", "[MpscRing]") {
+  MpscRing<int> ring(4);
+  for (int i = 0; i < 4; ++i) {
+    REQUIRE(ring.push(i));
+  }
+  REQUIRE_FALSE(ring.push(4));
+  REQUIRE(ring.size() == 4);
+
+  int item = -1;
+  REQUIRE(ring.pop(item));
+  REQUIRE(item == 0);
+  REQUIRE(ring.push(4));
+  for (int i = 1; i <= 4; ++i) {
+    REQUIRE(ring.pop(item));
+    REQUIRE(item == i);
+  }
+  REQUIRE_FALSE(ring.pop(item));
+  REQUIRE(ring.size() == 0);
+}
+
+TEST_CASE("MpscRing keeps the order of each producer", "[MpscRing]") {
+  const int producers = 4;
+  const int items = 20000;
+  MpscRing<std::pair<int, int>> ring(64);
+
+  std::vector<std::thread> threads;
+  for (int p = 0; p < producers; ++p) {
+    threads.emplace_back([&ring, p]() {
+      for (int i = 0; i < items; ++i) {
+        while (!ring.push({p, i})) std::this_thread::yield();
+      }
+    });
+  }
+
+  std::vector<int> next(producers, 0);
+  std::pair<int, int> item;
+  for (int received = 0; received < producers * items;) {
+    if (!ring.pop(item)) {
+      std::this_thread::yield();
+      continue;
+    }
+    REQUIRE(item.second == next[item.first]++);
+    ++received;
+  }
+  for (auto &t : threads) t.join();
+  REQUIRE(next == std::vector<int>(producers, items));
+}
@@ -0,0 +1,40 @@
+#include <sys/stat.h>
+
+#include <catch2/catch.hpp>
+#include <string>
+
+#include "common/util.h"
+#include "system/loggerd/segment_file.h"
+
+TEST_CASE("SegmentFile writes all data", "[SegmentFile]") {
+  const std::string filename = "test_segment_file";
+  std::string data;
+  {
+    SegmentFile file(filename);
+    // sizes around the page and chunk sizes
+    for (size_t size : {1ul, SegmentFile::PAGE_SIZE, SegmentFile::CHUNK_SIZE - 3, SegmentFile::CHUNK_SIZE * 2 + 7, 0ul, 12345ul}) {
+      std::string s = util::random_string(size);
+      REQUIRE(file.write(s.data(), s.size()));
+      data += s;
+      REQUIRE(file.size() == data.size());
+    }
+  }
+  REQUIRE(util::read_file(filename) == data);
+
+#ifndef __APPLE__
+  {
+    // the next file of the same name is preallocated
+    const std::string path = "./" + filename;
+    SegmentFile file(path);
+    struct stat st = {};
+    REQUIRE(stat(path.c_str(), &st) == 0);
+    REQUIRE(st.st_size == 0);
+    REQUIRE(st.st_blocks * 512 >= data.size());
+  }
+  struct stat st = {};
+  REQUIRE(stat(filename.c_str(), &st) == 0);
+  REQUIRE(st.st_size == 0);
+  REQUIRE(st.st_blocks == 0);
+#endif
+  std::remove(filename.c_str());
+}
@@ -1,7 +1,9 @@
 #include <zstd.h>
 
+#include <algorithm>
 #include <catch2/catch.hpp>
 #include <cstring>
+#include <memory>
 #include <vector>
 
 #include "common/util.h"
@@ -42,3 +44,119 @@ TEST_CASE("ZstdFileWriter writes and compresses data correctly in loops", "[Zstd
   // Clean up the test file
   std::remove(filename.c_str());
 }
+
+TEST_CASE("ZstdFileWriter compresses independent frames on a ZstdCompressPool", "[ZstdFileWriter]") {
+  const std::vector<std::string> filenames = {"test_zstd_pool_0.zst", "test_zstd_pool_1.zst"};
+  std::vector<std::string> totalTestData(filenames.size());
+
+  // Step 1: Write to several files sharing one pool, spanning multiple frames
+  {
+    auto pool = std::make_shared<ZstdCompressPool>(3);
+    std::vector<std::unique_ptr<ZstdFileWriter>> writers;
+    for (const auto &fn : filenames) {
+      writers.emplace_back(std::make_unique<ZstdFileWriter>(fn, LOG_COMPRESSION_LEVEL, pool));
+    }
+    for (int i = 0; i < 1000; ++i) {
+      for (int j = 0; j < writers.size(); ++j) {
+        std::string testData = util::random_string(8 * 1024 + i % 512);
+        totalTestData[j].append(testData);
+        writers[j]->write((void *)testData.c_str(), testData.size());
+      }
+    }
+    // files are closed by the pool's writer thread once all frames are written
+  }
+
+  // Step 2: Decompress each file and verify frames were written in order
+  for (int j = 0; j < filenames.size(); ++j) {
+    auto compressedContent = util::read_file(filenames[j]);
+    REQUIRE(compressedContent.size() > 0);
+    REQUIRE(compressedContent.size() < totalTestData[j].size());
+    std::string decompressedData = zstd_decompress(compressedContent);
+    REQUIRE(decompressedData.size() == totalTestData[j].size());
+    REQUIRE(std::memcmp(decompressedData.data(), totalTestData[j].c_str(), totalTestData[j].size()) == 0);
+    std::remove(filenames[j].c_str());
+  }
+}
+
+TEST_CASE("ZstdFileWriter writes a frame index", "[ZstdFileWriter]") {
+  const std::string filename = "test_zstd_index.zst";
+  const int num_events = 20000;
+  auto pool = GENERATE(std::shared_ptr<ZstdCompressPool>(), std::make_shared<ZstdCompressPool>(2));
+
+  std::string totalTestData;
+  {
+    ZstdFileWriter writer(filename, LOG_COMPRESSION_LEVEL, pool, true);
+    for (int i = 0; i < num_events; ++i) {
+      MessageBuilder msg;
+      auto evt = msg.initEvent();
+      evt.setLogMonoTime(i);
+      i % 2 ? (void)evt.initClocks() : evt.setLogMessage(util::random_string(100));
+      auto bytes = msg.toBytes();
+      totalTestData.append((const char *)bytes.begin(), bytes.size());
+      writer.write(bytes);
+    }
+  }
+  pool.reset();
+
+  auto compressedContent = util::read_file(filename);
+  REQUIRE(zstd_decompress(compressedContent) == totalTestData);
+
+  // parse the index from the trailing skippable frame
+  ZstdFrameIndexFooter footer;
+  memcpy(&footer, compressedContent.data() + compressedContent.size() - sizeof(footer), sizeof(footer));
+  REQUIRE(footer.magic == ZSTD_FRAME_INDEX_MAGIC);
+  REQUIRE(footer.num_frames > 1);
+
+  std::vector<ZstdFrameIndexEntry> index(footer.num_frames);
+  size_t index_size = index.size() * sizeof(ZstdFrameIndexEntry);
+  memcpy(index.data(), compressedContent.data() + compressedContent.size() - sizeof(footer) - index_size, index_size);
+
+  size_t offset = 0, decompressed_size = 0;
+  uint64_t next_mono_time = 0;
+  for (const auto &f : index) {
+    // every frame decompresses independently
+    std::string frame = zstd_decompress(compressedContent.substr(offset, f.compressed_size));
+    REQUIRE(frame.size() == f.decompressed_size);
+    REQUIRE(frame == totalTestData.substr(decompressed_size, f.decompressed_size));
+    REQUIRE(f.min_mono_time == next_mono_time);
+    REQUIRE(f.hasWhich(cereal::Event::Which::CLOCKS));
+    REQUIRE(f.hasWhich(cereal::Event::Which::LOG_MESSAGE));
+    REQUIRE(!f.hasWhich(cereal::Event::Which::CAN));
+    next_mono_time = f.max_mono_time + 1;
+    offset += f.compressed_size;
+    decompressed_size += f.decompressed_size;
+  }
+  REQUIRE(next_mono_time == num_events);
+  REQUIRE(decompressed_size == totalTestData.size());
+  std::remove(filename.c_str());
+}
+
+TEST_CASE("ZstdCompressPool blocks beyond its pending limit without losing frames", "[ZstdFileWriter]") {
+  const std::string filename = "test_zstd_pool_limit.zst";
+  const int num_frames = 20;
+  auto pool = std::make_shared<ZstdCompressPool>(1, 2);
+
+  std::string totalTestData;
+  {
+    ZstdFileWriter writer(filename, LOG_COMPRESSION_LEVEL, pool, true);
+    for (int i = 0; i < num_frames; ++i) {
+      // each write fills one frame
+      std::string frame = util::random_string(ZSTD_FRAME_SIZE);
+      totalTestData += frame;
+      writer.write((void *)frame.data(), frame.size());
+
+      size_t to_compress, to_write;
+      pool->queueDepths(to_compress, to_write);
+      REQUIRE(to_compress + to_write <= 2);
+    }
+  }
+  pool.reset();
+
+  // every frame is written, in order
+  auto compressedContent = util::read_file(filename);
+  ZstdFrameIndexFooter footer;
+  memcpy(&footer, compressedContent.data() + compressedContent.size() - sizeof(footer), sizeof(footer));
+  REQUIRE(footer.num_frames == num_frames);
+  REQUIRE(zstd_decompress(compressedContent) == totalTestData);
+  std::remove(filename.c_str());
+}
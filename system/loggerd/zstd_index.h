@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+
+// rlog/qlog are written as independent zstd frames, followed by an index of those frames
+// stored in a skippable frame, which regular zstd decoders ignore:
+//   [frame 0] ... [frame n-1] [skippable frame header][n x ZstdFrameIndexEntry][ZstdFrameIndexFooter]
+
+constexpr uint32_t ZSTD_SKIPPABLE_FRAME_MAGIC = 0x184D2A5E;
+constexpr uint32_t ZSTD_FRAME_INDEX_MAGIC = 0x5849504F;  // "OPIX"
+constexpr int ZSTD_FRAME_INDEX_WHICH_WORDS = 4;          // enough bits for all cereal::Event::Which
+
+struct ZstdFrameIndexEntry {
+  uint32_t compressed_size = 0;
+  uint32_t decompressed_size = 0;
+  uint64_t min_mono_time = UINT64_MAX;
+  uint64_t max_mono_time = 0;
+  uint64_t which[ZSTD_FRAME_INDEX_WHICH_WORDS] = {};  // bitmap of cereal::Event::Which in this frame
+
+  inline bool hasWhich(uint16_t w) const {
+    return w >= ZSTD_FRAME_INDEX_WHICH_WORDS * 64 || (which[w / 64] & (1ull << (w % 64)));
+  }
+  inline void addWhich(uint16_t w) {
+    if (w < ZSTD_FRAME_INDEX_WHICH_WORDS * 64) {
+      which[w / 64] |= (1ull << (w % 64));
+    } else {
+      for (auto &bits : which) bits = UINT64_MAX;
+    }
+  }
+};
+
+struct ZstdFrameIndexFooter {
+  uint32_t num_frames;
+  uint32_t magic = ZSTD_FRAME_INDEX_MAGIC;
+};
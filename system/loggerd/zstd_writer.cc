@@ -1,34 +1,62 @@
-
 #include "system/loggerd/zstd_writer.h"
 
+#include <algorithm>
 #include <cassert>
 
+#include <capnp/serialize.h>
+
+#include "cereal/gen/cpp/log.capnp.h"
 #include "common/util.h"
 
 // Constructor: Initializes compression stream and opens file
-ZstdFileWriter::ZstdFileWriter(const std::string& filename, int compression_level) {
-  // Create the compression stream
-  cstream_ = ZSTD_createCStream();
-  assert(cstream_);
+ZstdFileWriter::ZstdFileWriter(const std::string& filename, int compression_level, std::shared_ptr<ZstdCompressPool> pool,
+                               bool write_index)
+    : compression_level_(compression_level), pool_(pool) {
+  if (write_index) {
+    index_ = std::make_shared<std::vector<ZstdFrameIndexEntry>>();
+  }
+
+  if (pool_) {
+    // frames are compressed on the pool, only buffer the input here
+    input_cache_capacity_ = ZSTD_FRAME_SIZE;
+    input_cache_ = pool_->getBuffer();
+  } else {
+    // Create the compression stream
+    cstream_ = ZSTD_createCStream();
+    assert(cstream_);
 
-  size_t initResult = ZSTD_initCStream(cstream_, compression_level);
-  assert(!ZSTD_isError(initResult));
+    size_t initResult = ZSTD_initCStream(cstream_, compression_level);
+    assert(!ZSTD_isError(initResult));
 
-  input_cache_capacity_ = ZSTD_CStreamInSize();
-  input_cache_.reserve(input_cache_capacity_);
-  output_buffer_.resize(ZSTD_CStreamOutSize());
+    input_cache_capacity_ = ZSTD_CStreamInSize();
+    input_cache_.reserve(input_cache_capacity_);
+    output_buffer_.resize(ZSTD_CStreamOutSize());
+  }
 
-  file_ = util::safe_fopen(filename.c_str(), "wb");
-  assert(file_ != nullptr);
+  file_ = new SegmentFile(filename);
 }
 
-// Destructor: Finalizes compression and closes file
+// Destructor: Finalizes compression, writes the frame index and closes file
 ZstdFileWriter::~ZstdFileWriter() {
-  flushCache(true);
-  util::safe_fflush(file_);
+  if (pool_) {
+    if (!input_cache_.empty()) {
+      pool_->compress(file_, compression_level_, std::move(input_cache_), index_.get());
+    }
+    // the file is closed by the writer thread after its last frame is written
+    pool_->post([file = file_, index = index_]() {
+      if (index) zstd_write_index(file, *index);
+      delete file;
+    });
+    return;
+  }
 
-  int err = fclose(file_);
-  assert(err == 0);
+  if (!input_cache_.empty() || frame_input_size_ > 0) {
+    flushCache(true);
+  }
+  if (index_) {
+    zstd_write_index(file_, *index_);
+  }
+  delete file_;
 
   ZSTD_freeCStream(cstream_);
 }
@@ -40,14 +68,26 @@ void ZstdFileWriter::write(void* data, size_t size) {
 
   // If the cache is full, compress and write to the file
   if (input_cache_.size() >= input_cache_capacity_) {
-    flushCache(false);
+    flushCache(frame_input_size_ + input_cache_.size() >= ZSTD_FRAME_SIZE);
   }
 }
 
 // Compress and flush the input cache to the file
-void ZstdFileWriter::flushCache(bool last_chunk) {
+void ZstdFileWriter::flushCache(bool end_frame) {
+  if (pool_) {
+    // hand the cache over to the pool as an independent frame
+    pool_->compress(file_, compression_level_, std::move(input_cache_), index_.get());
+    input_cache_ = pool_->getBuffer();
+    return;
+  }
+
+  if (index_) {
+    zstd_index_events(input_cache_.data(), input_cache_.size(), index_entry_);
+  }
+  frame_input_size_ += input_cache_.size();
+
   ZSTD_inBuffer input = {input_cache_.data(), input_cache_.size(), 0};
-  ZSTD_EndDirective mode = !last_chunk ? ZSTD_e_continue : ZSTD_e_end;
+  ZSTD_EndDirective mode = !end_frame ? ZSTD_e_continue : ZSTD_e_end;
   int finished = 0;
 
   do {
@@ -55,11 +95,207 @@ void ZstdFileWriter::flushCache(bool last_chunk) {
     size_t remaining = ZSTD_compressStream2(cstream_, &output, &input, mode);
     assert(!ZSTD_isError(remaining));
 
-    size_t written = util::safe_fwrite(output_buffer_.data(), 1, output.pos, file_);
-    assert(written == output.pos);
+    bool ret = file_->write(output_buffer_.data(), output.pos);
+    assert(ret);
+    frame_output_size_ += output.pos;
 
-    finished = last_chunk ? (remaining == 0) : (input.pos == input.size);
+    finished = end_frame ? (remaining == 0) : (input.pos == input.size);
   } while (!finished);
 
+  if (end_frame) {
+    // the next write starts a new independent frame
+    if (index_) {
+      index_entry_.compressed_size = frame_output_size_;
+      index_entry_.decompressed_size = frame_input_size_;
+      index_->push_back(index_entry_);
+    }
+    index_entry_ = {};
+    frame_input_size_ = frame_output_size_ = 0;
+  }
+
   input_cache_.clear();  // Clear cache after compression
 }
+
+// Records the logMonoTime range and event types of serialized events
+void zstd_index_events(const char *data, size_t size, ZstdFrameIndexEntry &entry) {
+  kj::ArrayPtr<const capnp::word> words((const capnp::word *)data, size / sizeof(capnp::word));
+  try {
+    while (words.size() > 0) {
+      capnp::FlatArrayMessageReader reader(words);
+      auto event = reader.getRoot<cereal::Event>();
+      entry.addWhich(event.which());
+      entry.min_mono_time = std::min(entry.min_mono_time, event.getLogMonoTime());
+      entry.max_mono_time = std::max(entry.max_mono_time, event.getLogMonoTime());
+      words = kj::arrayPtr(reader.getEnd(), words.end());
+    }
+  } catch (const kj::Exception &e) {
+    // unparsable data, make the frame match any lookup
+    for (auto &bits : entry.which) bits = UINT64_MAX;
+    entry.min_mono_time = 0;
+    entry.max_mono_time = UINT64_MAX;
+  }
+}
+
+// Appends the frame index as a skippable frame
+void zstd_write_index(SegmentFile *file, const std::vector<ZstdFrameIndexEntry> &index) {
+  ZstdFrameIndexFooter footer = {.num_frames = (uint32_t)index.size()};
+  const uint32_t header[] = {ZSTD_SKIPPABLE_FRAME_MAGIC, uint32_t(index.size() * sizeof(ZstdFrameIndexEntry) + sizeof(footer))};
+
+  bool ret = file->write(header, sizeof(header));
+  ret &= file->write(index.data(), index.size() * sizeof(ZstdFrameIndexEntry));
+  ret &= file->write(&footer, sizeof(footer));
+  assert(ret);
+}
+
+// class ZstdCompressPool
+
+ZstdCompressPool::ZstdCompressPool(int num_workers, size_t max_pending) : max_pending_(max_pending) {
+  assert(num_workers > 0);
+  for (int i = 0; i < num_workers; ++i) {
+    workers_.emplace_back(&ZstdCompressPool::workerThread, this);
+  }
+  writer_ = std::thread(&ZstdCompressPool::writerThread, this);
+}
+
+// Destructor: waits until all submitted frames are written
+ZstdCompressPool::~ZstdCompressPool() {
+  {
+    std::lock_guard lk(lock_);
+    exit_ = true;
+  }
+  worker_cv_.notify_all();
+  for (auto &t : workers_) t.join();
+
+  writer_cv_.notify_one();
+  writer_.join();
+}
+
+std::vector<char> ZstdCompressPool::getBuffer() {
+  std::vector<char> buf;
+  {
+    std::lock_guard lk(lock_);
+    if (!free_buffers_.empty()) {
+      buf = std::move(free_buffers_.back());
+      free_buffers_.pop_back();
+    }
+  }
+  buf.clear();
+  buf.reserve(ZSTD_FRAME_SIZE);
+  return buf;
+}
+
+void ZstdCompressPool::compress(SegmentFile *file, int compression_level, std::vector<char> &&input,
+                                std::vector<ZstdFrameIndexEntry> *index) {
+  {
+    // the workers or the disk can't keep up, wait for a frame to be written
+    std::unique_lock lk(lock_);
+    pending_cv_.wait(lk, [this]() { return pending_.size() < max_pending_; });
+  }
+
+  auto job = std::make_unique<Job>();
+  job->file = file;
+  job->index = index;
+  job->compression_level = compression_level;
+  job->input = std::move(input);
+  job->output = getBuffer();
+  {
+    std::lock_guard lk(lock_);
+    to_compress_.push_back(job.get());
+    pending_.push_back(std::move(job));
+  }
+  worker_cv_.notify_one();
+}
+
+void ZstdCompressPool::post(std::function<void()> callback) {
+  auto job = std::make_unique<Job>();
+  job->callback = callback;
+  job->done = true;
+  {
+    std::lock_guard lk(lock_);
+    pending_.push_back(std::move(job));
+  }
+  writer_cv_.notify_one();
+}
+
+void ZstdCompressPool::queueDepths(size_t &to_compress, size_t &to_write) {
+  std::lock_guard lk(lock_);
+  to_compress = to_compress_.size();
+  to_write = pending_.size() - to_compress_.size();
+}
+
+void ZstdCompressPool::workerThread() {
+  util::set_thread_name("zstd_worker");
+  ZSTD_CCtx *cctx = ZSTD_createCCtx();
+  assert(cctx);
+
+  while (true) {
+    Job *job = nullptr;
+    {
+      std::unique_lock lk(lock_);
+      worker_cv_.wait(lk, [this]() { return exit_ || !to_compress_.empty(); });
+      if (to_compress_.empty()) break;  // only exit after all queued frames are compressed
+
+      job = to_compress_.front();
+      to_compress_.pop_front();
+    }
+
+    if (job->index) {
+      zstd_index_events(job->input.data(), job->input.size(), job->index_entry);
+    }
+
+    size_t ret = ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, job->compression_level);
+    assert(!ZSTD_isError(ret));
+
+    job->output.resize(ZSTD_compressBound(job->input.size()));
+    size_t size = ZSTD_compress2(cctx, job->output.data(), job->output.size(), job->input.data(), job->input.size());
+    assert(!ZSTD_isError(size));
+    job->output.resize(size);
+    job->index_entry.compressed_size = size;
+    job->index_entry.decompressed_size = job->input.size();
+
+    {
+      std::lock_guard lk(lock_);
+      job->done = true;
+    }
+    writer_cv_.notify_one();
+  }
+
+  ZSTD_freeCCtx(cctx);
+}
+
+void ZstdCompressPool::writerThread() {
+  util::set_thread_name("zstd_writer");
+
+  while (true) {
+    std::unique_ptr<Job> job;
+    {
+      std::unique_lock lk(lock_);
+      writer_cv_.wait(lk, [this]() { return (!pending_.empty() && pending_.front()->done) || (exit_ && pending_.empty()); });
+      if (pending_.empty()) break;
+
+      job = std::move(pending_.front());
+      pending_.pop_front();
+    }
+    pending_cv_.notify_one();
+
+    if (job->callback) {
+      job->callback();
+    } else {
+      if (job->file->write(job->output.data(), job->output.size())) {
+        if (job->index) {
+          job->index->push_back(job->index_entry);
+        }
+      } else {
+        ++write_dropped_;
+      }
+    }
+
+    // recycle the buffers, keeping a few around for the next frames
+    std::lock_guard lk(lock_);
+    for (auto buf : {&job->input, &job->output}) {
+      if (buf->capacity() > 0 && free_buffers_.size() < 8) {
+        free_buffers_.push_back(std::move(*buf));
+      }
+    }
+  }
+}
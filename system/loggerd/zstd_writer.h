@@ -2,23 +2,92 @@
 
 #include <zstd.h>
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 #include <capnp/common.h>
 
+#include "system/loggerd/segment_file.h"
+#include "system/loggerd/zstd_index.h"
+
+// size of the uncompressed input of each independent frame
+constexpr size_t ZSTD_FRAME_SIZE = 1024 * 1024;
+// frames waiting to be compressed or written, compress() blocks beyond it
+constexpr size_t ZSTD_MAX_PENDING_FRAMES = 32;
+
+// Compresses independent zstd frames on a pool of worker threads.
+// A dedicated writer thread appends the frames to their files in submission order.
+class ZstdCompressPool {
+public:
+  ZstdCompressPool(int num_workers, size_t max_pending = ZSTD_MAX_PENDING_FRAMES);
+  ~ZstdCompressPool();
+  std::vector<char> getBuffer();
+  // index is appended to on the writer thread if not null. blocks while max_pending frames are pending, so
+  // a stalled disk fills loggerd's queue, where the messages that don't fit are dropped and counted.
+  void compress(SegmentFile *file, int compression_level, std::vector<char> &&input, std::vector<ZstdFrameIndexEntry> *index = nullptr);
+  // run callback on the writer thread once everything submitted before it has been written
+  void post(std::function<void()> callback);
+  // frames waiting for a worker, and frames that are compressed or being compressed but not yet written
+  void queueDepths(size_t &to_compress, size_t &to_write);
+  // frames that failed to be written
+  uint64_t writeDropped() const { return write_dropped_; }
+
+private:
+  struct Job {
+    SegmentFile *file = nullptr;
+    int compression_level = 0;
+    std::vector<char> input;
+    std::vector<char> output;
+    std::vector<ZstdFrameIndexEntry> *index = nullptr;
+    ZstdFrameIndexEntry index_entry;
+    std::function<void()> callback;
+    bool done = false;
+  };
+  void workerThread();
+  void writerThread();
+
+  std::mutex lock_;
+  std::condition_variable worker_cv_, writer_cv_, pending_cv_;
+  std::deque<std::unique_ptr<Job>> pending_;  // all jobs in submission order
+  std::deque<Job *> to_compress_;
+  std::vector<std::vector<char>> free_buffers_;
+  std::vector<std::thread> workers_;
+  std::thread writer_;
+  bool exit_ = false;
+  const size_t max_pending_;
+  std::atomic<uint64_t> write_dropped_ = 0;
+};
+
 class ZstdFileWriter {
 public:
-  ZstdFileWriter(const std::string &filename, int compression_level);
+  // write_index requires each write() to be a complete serialized cereal::Event
+  ZstdFileWriter(const std::string &filename, int compression_level, std::shared_ptr<ZstdCompressPool> pool = nullptr,
+                 bool write_index = false);
   ~ZstdFileWriter();
   void write(void* data, size_t size);
   inline void write(kj::ArrayPtr<capnp::byte> array) { write(array.begin(), array.size()); }
 
 private:
-  void flushCache(bool last_chunk);
+  void flushCache(bool end_frame);
 
+  int compression_level_;
+  size_t frame_input_size_ = 0;
+  size_t frame_output_size_ = 0;
+  ZstdFrameIndexEntry index_entry_;
+  std::shared_ptr<std::vector<ZstdFrameIndexEntry>> index_;
   size_t input_cache_capacity_ = 0;
   std::vector<char> input_cache_;
   std::vector<char> output_buffer_;
-  ZSTD_CStream *cstream_;
-  FILE* file_ = nullptr;
+  ZSTD_CStream *cstream_ = nullptr;
+  SegmentFile *file_ = nullptr;
+  std::shared_ptr<ZstdCompressPool> pool_;
 };
+
+void zstd_index_events(const char *data, size_t size, ZstdFrameIndexEntry &entry);
+void zstd_write_index(SegmentFile *file, const std::vector<ZstdFrameIndexEntry> &index);
@@ -1,6 +1,7 @@
 #include "tools/cabana/chart/chart.h"
 
 #include <algorithm>
+#include <cmath>
 #include <limits>
 
 #include <QActionGroup>
@@ -218,6 +219,9 @@ void ChartView::updatePlotArea(int left_pos, bool force) {
     x_label_size += QSizeF{5, 5};
     chart()->setPlotArea(rect().adjusted(align_to + left, adjust_top + top, -x_label_size.width() / 2 - right, -x_label_size.height() - bottom));
     chart()->layout()->invalidate();
+    for (auto &s : sigs) {
+      updateSeriesData(s);
+    }
     resetChartCache();
   }
 }
@@ -248,6 +252,9 @@ void ChartView::updatePlot(double cur, double min, double max) {
   cur_sec = cur;
   if (min != axis_x->min() || max != axis_x->max()) {
     axis_x->setRange(min, max);
+    for (auto &s : sigs) {
+      updateSeriesData(s);
+    }
     updateAxisY();
     updateSeriesPoints();
     // update tooltip
@@ -282,49 +289,53 @@ void ChartView::updateSeriesPoints() {
   }
 }
 
-void ChartView::appendCanEvents(const cabana::Signal *sig, const std::vector<const CanEvent *> &events,
-                                std::vector<QPointF> &vals, std::vector<QPointF> &step_vals) {
-  vals.reserve(vals.size() + events.capacity());
-  step_vals.reserve(step_vals.size() + events.capacity() * 2);
-
-  double value = 0;
-  for (const CanEvent *e : events) {
-    if (sig->getValue(e->dat, e->size, &value)) {
-      const double ts = can->toSeconds(e->mono_time);
-      vals.emplace_back(ts, value);
-      if (!step_vals.empty())
-        step_vals.emplace_back(ts, step_vals.back().y());
-      step_vals.emplace_back(ts, value);
+void ChartView::appendSeries(const SignalSeries &series, size_t first, size_t last, std::vector<QPointF> &vals) {
+  vals.reserve(vals.size() + (last - first));
+  series.forEach(first, last, [&](uint64_t mono_time, double value) {
+    if (!std::isnan(value)) {
+      vals.emplace_back(can->toSeconds(mono_time), value);
     }
-  }
+  });
 }
 
 void ChartView::updateSeries(const cabana::Signal *sig, const MessageEventsMap *msg_new_events) {
   for (auto &s : sigs) {
     if (!sig || s.sig == sig) {
+      size_t first = 0, last = 0;
+      s.signal_series = can->signalSeries(s.msg_id, s.sig);
+      const auto &series = s.signal_series;
       if (!msg_new_events) {
         s.vals.clear();
-        s.step_vals.clear();
+        if (series->empty()) continue;
+        last = series->size();
+      } else {
+        auto it = msg_new_events->find(s.msg_id);
+        if (it == msg_new_events->end() || it->second.empty()) continue;
+
+        // the range of the series the new events were merged into, they may interleave with existing events
+        first = series->lowerBound(it->second.front()->mono_time);
+        last = series->upperBound(it->second.back()->mono_time);
       }
-      auto events = msg_new_events ? msg_new_events : &can->eventsMap();
-      auto it = events->find(s.msg_id);
-      if (it == events->end() || it->second.empty()) continue;
 
-      if (s.vals.empty() || can->toSeconds(it->second.back()->mono_time) > s.vals.back().x()) {
-        appendCanEvents(s.sig, it->second, s.vals, s.step_vals);
+      size_t changed = s.vals.size();
+      if (s.vals.empty() || first == last || can->toSeconds(series->monoTime(first)) > s.vals.back().x()) {
+        appendSeries(*series, first, last, s.vals);
       } else {
-        std::vector<QPointF> vals, step_vals;
-        appendCanEvents(s.sig, it->second, vals, step_vals);
-        s.vals.insert(std::lower_bound(s.vals.begin(), s.vals.end(), vals.front().x(), xLessThan),
-                      vals.begin(), vals.end());
-        s.step_vals.insert(std::lower_bound(s.step_vals.begin(), s.step_vals.end(), step_vals.front().x(), xLessThan),
-                           step_vals.begin(), step_vals.end());
+        // replace the points of the merged range
+        const double min_x = can->toSeconds(series->monoTime(first)), max_x = can->toSeconds(series->monoTime(last - 1));
+        auto begin = std::partition_point(s.vals.begin(), s.vals.end(), [=](auto &p) { return p.x() < min_x; });
+        auto end = std::partition_point(begin, s.vals.end(), [=](auto &p) { return p.x() <= max_x; });
+        std::vector<QPointF> vals;
+        appendSeries(*series, first, last, vals);
+        changed = begin - s.vals.begin();
+        s.vals.insert(s.vals.erase(begin, end), vals.begin(), vals.end());
       }
 
       if (!can->liveStreaming()) {
         s.segment_tree.build(s.vals);
       }
-      s.series->replace(QVector<QPointF>::fromStdVector(series_type == SeriesType::StepLine ? s.step_vals : s.vals));
+      s.pyramid.update(s.vals, changed);
+      updateSeriesData(s);
     }
   }
   updateAxisY();
@@ -332,6 +343,41 @@ void ChartView::updateSeries(const cabana::Signal *sig, const MessageEventsMap *
   QMetaObject::invokeMethod(this, &ChartView::resetChartCache, Qt::QueuedConnection);
 }
 
+void ChartView::updateSeriesData(SigItem &s) {
+  auto first = std::lower_bound(s.vals.cbegin(), s.vals.cend(), axis_x->min(), xLessThan);
+  auto last = std::lower_bound(first, s.vals.cend(), axis_x->max(), xLessThan);
+  // one more point on each side to draw the lines to the edges
+  const int first_idx = std::max<int>(first - s.vals.cbegin() - 1, 0);
+  const int last_idx = std::min<int>(last - s.vals.cbegin() + 1, s.vals.size());
+
+  // about 2 points per pixel are enough to draw the visible range
+  std::vector<QPointF> points;
+  const int max_points = std::max(2 * (int)chart()->plotArea().width(), 200);
+  s.pyramid.decimate(s.vals, first_idx, last_idx, max_points, points);
+
+  if (series_type == SeriesType::StepLine) {
+    std::vector<QPointF> step_points;
+    step_points.reserve(points.size() * 2);
+    for (const auto &pt : points) {
+      if (!step_points.empty())
+        step_points.emplace_back(pt.x(), step_points.back().y());
+      step_points.emplace_back(pt);
+    }
+    points = std::move(step_points);
+  }
+  s.series->replace(QVector<QPointF>::fromStdVector(points));
+}
+
+void ChartView::removePointsBefore(double sec) {
+  for (auto &s : sigs) {
+    s.vals.erase(s.vals.begin(), std::lower_bound(s.vals.begin(), s.vals.end(), sec, xLessThan));
+    s.pyramid.build(s.vals);
+    updateSeriesData(s);
+  }
+  updateAxisY();
+  resetChartCache();
+}
+
 // auto zoom on yaxis
 void ChartView::updateAxisY() {
   if (sigs.empty()) return;
@@ -838,7 +884,7 @@ void ChartView::setSeriesType(SeriesType type) {
     }
     for (auto &s : sigs) {
       s.series = createSeries(series_type, s.sig->color);
-      s.series->replace(QVector<QPointF>::fromStdVector(series_type == SeriesType::StepLine ? s.step_vals : s.vals));
+      updateSeriesData(s);
     }
     updateSeriesPoints();
     updateTitle();
@@ -33,6 +33,7 @@ public:
   void addSignal(const MessageId &msg_id, const cabana::Signal *sig);
   bool hasSignal(const MessageId &msg_id, const cabana::Signal *sig) const;
   void updateSeries(const cabana::Signal *sig = nullptr, const MessageEventsMap *msg_new_events = nullptr);
+  void removePointsBefore(double sec);
   void updatePlot(double cur, double min, double max);
   void setSeriesType(SeriesType type);
   void updatePlotArea(int left, bool force = false);
@@ -45,10 +46,11 @@ public:
     MessageId msg_id;
     const cabana::Signal *sig = nullptr;
     QXYSeries *series = nullptr;
+    std::shared_ptr<const SignalSeries> signal_series;  // held while the signal is charted
     std::vector<QPointF> vals;
-    std::vector<QPointF> step_vals;
     QPointF track_pt{};
     SegmentTree segment_tree;
+    MinMaxPyramid pyramid;
     double min = 0;
     double max = 0;
   };
@@ -65,8 +67,8 @@ private slots:
   void signalRemoved(const cabana::Signal *sig) { removeIf([=](auto &s) { return s.sig == sig; }); }
 
 private:
-  void appendCanEvents(const cabana::Signal *sig, const std::vector<const CanEvent *> &events,
-                       std::vector<QPointF> &vals, std::vector<QPointF> &step_vals);
+  void appendSeries(const SignalSeries &series, size_t first, size_t last, std::vector<QPointF> &vals);
+  void updateSeriesData(SigItem &s);
   void createToolButtons();
   void addSeries(QXYSeries *series);
   void contextMenuEvent(QContextMenuEvent *event) override;
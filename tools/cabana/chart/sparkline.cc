@@ -1,18 +1,21 @@
 #include "tools/cabana/chart/sparkline.h"
 
 #include <algorithm>
+#include <cmath>
 #include <limits>
 #include <QPainter>
 
 void Sparkline::update(const MessageId &msg_id, const cabana::Signal *sig, double last_msg_ts, int range, QSize size) {
   points.clear();
-  double value = 0;
-  auto [first, last] = can->eventsInRange(msg_id, std::make_pair(last_msg_ts -range, last_msg_ts));
-  for (auto it = first; it != last; ++it) {
-    if (sig->getValue((*it)->dat, (*it)->size, &value)) {
-      points.emplace_back(((*it)->mono_time - (*first)->mono_time) / 1e9, value);
+  series = can->signalSeries(msg_id, sig);
+  const size_t first = series->lowerBound(can->toMonoTime(last_msg_ts - range));
+  const size_t last = std::max(first, series->upperBound(can->toMonoTime(last_msg_ts)));
+  const uint64_t first_time = first < last ? series->monoTime(first) : 0;
+  series->forEach(first, last, [&](uint64_t mono_time, double value) {
+    if (!std::isnan(value)) {
+      points.emplace_back((mono_time - first_time) / 1e9, value);
     }
-  }
+  });
 
   if (points.empty() || size.isEmpty()) {
     pixmap = QPixmap();
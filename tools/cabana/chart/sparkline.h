@@ -20,6 +20,7 @@ public:
 private:
   void render(const QColor &color, int range, QSize size);
 
+  std::shared_ptr<const SignalSeries> series;  // held while the sparkline is shown
   std::vector<QPointF> points;
   double freq_ = 0;
 };
@@ -177,6 +177,60 @@ bool cabana::Signal::operator==(const cabana::Signal &other) const {
          multiplex_value == other.multiplex_value && type == other.type && receiver_name == other.receiver_name;
 }
 
+// cabana::SignalDecoder
+
+cabana::SignalDecoder::SignalDecoder(const Signal &sig) {
+  plan.compile(sig);
+  if (sig.multiplexor) {
+    mux_plan.compile(*sig.multiplexor);
+    has_multiplexor = true;
+    multiplex_value = sig.multiplex_value;
+  }
+}
+
+void cabana::SignalDecoder::Plan::compile(const Signal &sig) {
+  msb = sig.msb;
+  lsb = sig.lsb;
+  size = sig.size;
+  is_little_endian = sig.is_little_endian;
+  is_signed = sig.is_signed && size > 0 && size <= 64;
+  sign_shift = 64 - size;
+  factor = sig.factor;
+  offset = sig.offset;
+
+  // little endian signals run from the lsb byte up to the msb byte, big endian ones from the msb byte up
+  const int first_byte = (sig.is_little_endian ? lsb : msb) / 8;
+  const int last_byte = (sig.is_little_endian ? msb : lsb) / 8;
+  fast = size > 0 && size <= 64 && lsb >= 0 && msb >= 0 && last_byte >= first_byte && last_byte - first_byte < 8;
+  if (fast) {
+    big_endian = !sig.is_little_endian;
+    msb_byte = msb / 8;
+    load_byte = first_byte;
+    shift = big_endian ? 56 - 8 * (last_byte - first_byte) + lsb % 8 : lsb % 8;
+    mask = size == 64 ? ~0ULL : (1ULL << size) - 1;
+  }
+}
+
+// fallback for signals spanning more than 8 bytes
+uint64_t cabana::SignalDecoder::Plan::read_bits(const uint8_t *data, size_t data_size) const {
+  uint64_t val = 0;
+
+  int i = msb / 8;
+  int bits = size;
+  while (i >= 0 && i < data_size && bits > 0) {
+    int byte_lsb = (int)(lsb / 8) == i ? lsb : i * 8;
+    int byte_msb = (int)(msb / 8) == i ? msb : (i + 1) * 8 - 1;
+    int byte_size = byte_msb - byte_lsb + 1;
+
+    uint64_t d = (data[i] >> (byte_lsb - (i * 8))) & ((1ULL << byte_size) - 1);
+    val |= d << (bits - byte_size);
+
+    bits -= byte_size;
+    i = is_little_endian ? i - 1 : i + 1;
+  }
+  return val;
+}
+
 // helper functions
 
 double get_raw_value(const uint8_t *data, size_t data_size, const cabana::Signal &sig) {
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <algorithm>
+#include <cstring>
 #include <limits>
 #include <utility>
 #include <vector>
@@ -85,6 +87,65 @@ public:
   Signal *multiplexor = nullptr;
 };
 
+// Decodes a signal with a plan compiled from its layout: signals within 8 bytes take one
+// unaligned 64-bit load (byteswapped for big endian) and a shift/mask.
+class SignalDecoder {
+public:
+  SignalDecoder(const Signal &sig);
+  // same as get_raw_value(), the multiplexor is not checked
+  inline double value(const uint8_t *data, size_t data_size) const { return plan.decode(data, data_size); }
+  inline bool getValue(const uint8_t *data, size_t data_size, double *val) const {
+    if (has_multiplexor && mux_plan.decode(data, data_size) != multiplex_value) return false;
+    *val = plan.decode(data, data_size);
+    return true;
+  }
+  // decodes the CanEvents in [first, last) into values, NaN if the multiplexor does not match
+  template <class Iter>
+  void decode(Iter first, Iter last, double *values) const {
+    for (; first != last; ++first, ++values) {
+      const auto *e = *first;
+      *values = has_multiplexor && mux_plan.decode(e->dat, e->size) != multiplex_value
+                  ? std::numeric_limits<double>::quiet_NaN()
+                  : plan.decode(e->dat, e->size);
+    }
+  }
+
+  // fast signals load 8 bytes from load_byte, swap them if big endian, then shift and mask
+  struct Plan {
+    void compile(const Signal &sig);
+    inline double decode(const uint8_t *data, size_t data_size) const {
+      uint64_t raw = 0;
+      if (!fast) {
+        raw = read_bits(data, data_size);
+      } else if (msb_byte < data_size) {
+        uint64_t d = 0;
+        memcpy(&d, data + load_byte, std::min<size_t>(8, data_size - load_byte));
+        if (big_endian) d = __builtin_bswap64(d);
+        raw = (d >> shift) & mask;
+      }
+      int64_t val = is_signed ? (int64_t)(raw << sign_shift) >> sign_shift : (int64_t)raw;
+      return val * factor + offset;
+    }
+    uint64_t read_bits(const uint8_t *data, size_t data_size) const;
+
+    bool fast = false;
+    bool big_endian = false;
+    bool is_signed = false;
+    bool is_little_endian = true;
+    int msb = 0, lsb = 0, size = 0;
+    size_t msb_byte = 0, load_byte = 0;
+    int shift = 0, sign_shift = 0;
+    uint64_t mask = 0;
+    double factor = 1.0, offset = 0;
+  };
+  const Plan &valuePlan() const { return plan; }
+
+private:
+  Plan plan, mux_plan;
+  bool has_multiplexor = false;
+  int multiplex_value = 0;
+};
+
 class Msg {
 public:
   Msg() = default;
@@ -1,6 +1,8 @@
 #include "tools/cabana/historylog.h"
 
+#include <cmath>
 #include <functional>
+#include <limits>
 
 #include <QFileDialog>
 #include <QPainter>
@@ -34,6 +36,7 @@ void HistoryLogModel::setMessage(const MessageId &message_id) {
 void HistoryLogModel::reset() {
   beginResetModel();
   sigs.clear();
+  series.clear();
   if (auto dbc_msg = dbc()->msg(msg_id)) {
     sigs = dbc_msg->getSignals();
   }
@@ -84,6 +87,18 @@ void HistoryLogModel::updateState(bool clear) {
   fetchData(messages.begin(), current_time, messages.empty() ? 0 : messages.front().mono_time);
 }
 
+void HistoryLogModel::removeEvicted() {
+  // messages are sorted from the latest to the oldest
+  const auto &events = can->events(msg_id);
+  uint64_t min_time = !events.empty() ? events.front()->mono_time : std::numeric_limits<uint64_t>::max();
+  auto it = std::partition_point(messages.begin(), messages.end(), [=](auto &m) { return m.mono_time >= min_time; });
+  if (it != messages.end()) {
+    beginRemoveRows({}, it - messages.begin(), messages.size() - 1);
+    messages.erase(it, messages.end());
+    endRemoveRows();
+  }
+}
+
 bool HistoryLogModel::canFetchMore(const QModelIndex &parent) const {
   const auto &events = can->events(msg_id);
   return !events.empty() && !messages.empty() && messages.back().mono_time > events.front()->mono_time;
@@ -100,13 +115,19 @@ void HistoryLogModel::fetchData(std::deque<Message>::iterator insert_pos, uint64
     return ts > e->mono_time;
   });
 
+  series.clear();
+  for (auto sig : sigs) {
+    series.push_back(can->signalSeries(msg_id, sig));
+  }
+
   std::vector<HistoryLogModel::Message> msgs;
   std::vector<double> values(sigs.size());
   msgs.reserve(batch_size);
   for (; first != events.rend() && (*first)->mono_time > min_time; ++first) {
     const CanEvent *e = *first;
+    const size_t idx = std::distance(first, events.rend()) - 1;
     for (int i = 0; i < sigs.size(); ++i) {
-      sigs[i]->getValue(e->dat, e->size, &values[i]);
+      if (double v = series[i]->value(idx); !std::isnan(v)) values[i] = v;
     }
     if (!filter_cmp || filter_cmp(values[filter_sig_idx], filter_value)) {
        msgs.emplace_back(Message{e->mono_time, values, {e->dat, e->dat + e->size}});
@@ -207,6 +228,7 @@ LogsWidget::LogsWidget(QWidget *parent) : QFrame(parent) {
   QObject::connect(value_edit, &QLineEdit::textEdited, this, &LogsWidget::filterChanged);
   QObject::connect(export_btn, &QToolButton::clicked, this, &LogsWidget::exportToCSV);
   QObject::connect(can, &AbstractStream::seekedTo, model, &HistoryLogModel::reset);
+  QObject::connect(can, &AbstractStream::eventsEvicted, model, &HistoryLogModel::removeEvicted);
   QObject::connect(dbc(), &DBCManager::DBCFileChanged, model, &HistoryLogModel::reset);
   QObject::connect(UndoStack::instance(), &QUndoStack::indexChanged, model, &HistoryLogModel::reset);
   QObject::connect(model, &HistoryLogModel::modelReset, this, &LogsWidget::modelReset);
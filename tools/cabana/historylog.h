@@ -35,6 +35,7 @@ public:
   inline bool isHexMode() const { return sigs.empty() || hex_mode; }
   void reset();
   void setHexMode(bool hex_mode);
+  void removeEvicted();
 
   struct Message {
     uint64_t mono_time = 0;
@@ -53,6 +54,7 @@ public:
   std::function<bool(double, double)> filter_cmp = nullptr;
   std::deque<Message> messages;
   std::vector<cabana::Signal *> sigs;
+  std::vector<std::shared_ptr<const SignalSeries>> series;  // of sigs, held while the log is shown
   bool hex_mode = false;
 };
 
@@ -23,6 +23,7 @@ void settings_op(SettingOperation op) {
   op(s, "absolute_time", settings.absolute_time);
   op(s, "fps", settings.fps);
   op(s, "max_cached_minutes", settings.max_cached_minutes);
+  op(s, "max_cached_mb", settings.max_cached_mb);
   op(s, "chart_height", settings.chart_height);
   op(s, "chart_range", settings.chart_range);
   op(s, "chart_column_count", settings.chart_column_count);
@@ -78,6 +79,13 @@ SettingsDlg::SettingsDlg(QWidget *parent) : QDialog(parent) {
   cached_minutes->setRange(MIN_CACHE_MINIUTES, MAX_CACHE_MINIUTES);
   cached_minutes->setSingleStep(1);
   cached_minutes->setValue(settings.max_cached_minutes);
+
+  form_layout->addRow(tr("Max Live Stream Memory"), cached_mb = new QSpinBox(this));
+  cached_mb->setToolTip(tr("Live streams keep the events of the last cached minutes, within this memory limit"));
+  cached_mb->setRange(256, 64 * 1024);
+  cached_mb->setSingleStep(256);
+  cached_mb->setSuffix(" MB");
+  cached_mb->setValue(settings.max_cached_mb);
   main_layout->addWidget(groupbox);
 
   groupbox = new QGroupBox("New Signal Settings");
@@ -128,6 +136,7 @@ void SettingsDlg::save() {
   }
   settings.fps = fps->value();
   settings.max_cached_minutes = cached_minutes->value();
+  settings.max_cached_mb = cached_mb->value();
   settings.chart_height = chart_height->value();
   settings.log_livestream = log_livestream->isChecked();
   settings.log_path = log_path->text();
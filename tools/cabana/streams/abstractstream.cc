@@ -7,19 +7,26 @@
 #include "common/timing.h"
 #include "tools/cabana/settings.h"
 
-static const int EVENT_NEXT_BUFFER_SIZE = 6 * 1024 * 1024;  // 6MB
-
 AbstractStream *can = nullptr;
 
 AbstractStream::AbstractStream(QObject *parent) : QObject(parent) {
   assert(parent != nullptr);
-  event_buffer_ = std::make_unique<MonotonicBuffer>(EVENT_NEXT_BUFFER_SIZE);
 
   QObject::connect(this, &AbstractStream::privateUpdateLastMsgsSignal, this, &AbstractStream::updateLastMessages, Qt::QueuedConnection);
   QObject::connect(this, &AbstractStream::seekedTo, this, &AbstractStream::updateLastMsgsTo);
   QObject::connect(this, &AbstractStream::seeking, this, [this](double sec) { current_sec_ = sec; });
   QObject::connect(dbc(), &DBCManager::DBCFileChanged, this, &AbstractStream::updateMasks);
   QObject::connect(dbc(), &DBCManager::maskUpdated, this, &AbstractStream::updateMasks);
+  // edited signals are decoded again on their next use
+  QObject::connect(dbc(), &DBCManager::signalRemoved, this, [this](const cabana::Signal *sig) {
+    signal_cache_.remove([=](auto &, auto s) { return s == sig; });
+  });
+  QObject::connect(dbc(), &DBCManager::msgRemoved, this, [this](MessageId id) {
+    signal_cache_.remove([=](auto &msg_id, auto) { return msg_id.address == id.address; });
+  });
+  QObject::connect(dbc(), &DBCManager::DBCFileChanged, this, [this]() {
+    signal_cache_.remove([](auto &, auto) { return true; });
+  });
 }
 
 void AbstractStream::updateMasks() {
@@ -115,8 +122,8 @@ void AbstractStream::updateEvent(const MessageId &id, double sec, const uint8_t
   new_msgs_.insert(id);
 }
 
-const std::vector<const CanEvent *> &AbstractStream::events(const MessageId &id) const {
-  static std::vector<const CanEvent *> empty_events;
+const CanEventList &AbstractStream::events(const MessageId &id) const {
+  static CanEventList empty_events;
   auto it = events_.find(id);
   return it != events_.end() ? it->second : empty_events;
 }
@@ -189,7 +196,7 @@ void AbstractStream::waitForSeekFinshed() {
 
 const CanEvent *AbstractStream::newEvent(uint64_t mono_time, const cereal::CanData::Reader &c) {
   auto dat = c.getDat();
-  CanEvent *e = (CanEvent *)event_buffer_->allocate(sizeof(CanEvent) + sizeof(uint8_t) * dat.size());
+  CanEvent *e = event_store_.allocate(mono_time, dat.size());
   e->src = c.getSrc();
   e->address = c.getAddress();
   e->mono_time = mono_time;
@@ -210,17 +217,30 @@ void AbstractStream::mergeEvents(const std::vector<const CanEvent *> &events) {
   if (!events.empty()) {
     for (const auto &[id, new_e] : msg_events) {
       if (!new_e.empty()) {
-        auto &e = events_[id];
-        auto pos = std::upper_bound(e.cbegin(), e.cend(), new_e.front()->mono_time, CompareCanEvent());
-        e.insert(pos, new_e.cbegin(), new_e.cend());
+        events_[id].merge(new_e);
       }
     }
-    auto pos = std::upper_bound(all_events_.cbegin(), all_events_.cend(), events.front()->mono_time, CompareCanEvent());
-    all_events_.insert(pos, events.cbegin(), events.cend());
+    all_events_.merge(events);
+    signal_cache_.merge(msg_events);
     emit eventsMerged(msg_events);
   }
 }
 
+void AbstractStream::evictEvents(uint64_t min_mono_time, size_t max_bytes) {
+  if (event_holds_ > 0) return;
+
+  uint64_t evicted_ts = event_store_.evict(min_mono_time, max_bytes);
+  if (evicted_ts == 0) return;
+
+  // all freed events are at or before evicted_ts
+  for (auto &[_, e] : events_) {
+    e.eraseUntil(evicted_ts);
+  }
+  all_events_.eraseUntil(evicted_ts);
+  signal_cache_.evict(evicted_ts);
+  emit eventsEvicted(toSeconds(all_events_.empty() ? evicted_ts + 1 : all_events_.front()->mono_time));
+}
+
 std::pair<CanEventIter, CanEventIter> AbstractStream::eventsInRange(const MessageId &id, std::optional<std::pair<double, double>> time_range) const {
   const auto &events = can->events(id);
   if (!time_range) return {events.begin(), events.end()};
@@ -230,6 +250,283 @@ std::pair<CanEventIter, CanEventIter> AbstractStream::eventsInRange(const Messag
   return {first, last};
 }
 
+// CanEventList
+
+void CanEventList::merge(const std::vector<const CanEvent *> &events) {
+  if (events.empty()) return;
+
+  // chunks with events in (first_ts, last_ts] interleave with the new events
+  const uint64_t first_ts = events.front()->mono_time, last_ts = events.back()->mono_time;
+  auto first = std::partition_point(chunks_.begin(), chunks_.end(), [=](auto &c) { return c.back()->mono_time <= first_ts; });
+  auto last = std::partition_point(first, chunks_.end(), [=](auto &c) { return c.front()->mono_time <= last_ts; });
+  if (first == last) {
+    if (first == chunks_.end() && !chunks_.empty() && chunks_.back().size() < MAX_APPEND_CHUNK_SIZE) {
+      chunks_.back().insert(chunks_.back().end(), events.begin(), events.end());
+    } else {
+      chunks_.insert(first, events);
+    }
+  } else {
+    std::vector<const CanEvent *> existing;
+    for (auto it = first; it != last; ++it) {
+      existing.insert(existing.end(), it->begin(), it->end());
+    }
+    std::vector<const CanEvent *> merged;
+    merged.reserve(existing.size() + events.size());
+    std::merge(existing.begin(), existing.end(), events.begin(), events.end(), std::back_inserter(merged),
+               [](const CanEvent *l, const CanEvent *r) { return l->mono_time < r->mono_time; });
+    *first = std::move(merged);
+    chunks_.erase(first + 1, last);
+  }
+  updateOffsets();
+}
+
+void CanEventList::eraseUntil(uint64_t mono_time) {
+  auto last = std::partition_point(chunks_.begin(), chunks_.end(), [=](auto &c) { return c.back()->mono_time <= mono_time; });
+  chunks_.erase(chunks_.begin(), last);
+  if (!chunks_.empty()) {
+    auto &c = chunks_.front();
+    c.erase(c.begin(), std::upper_bound(c.begin(), c.end(), mono_time, CompareCanEvent()));
+  }
+  updateOffsets();
+}
+
+CanEventList::const_iterator CanEventList::iteratorAt(size_t index) const {
+  const_iterator it;
+  it.list_ = this;
+  it.index_ = index;
+  if (index >= size_) {
+    it.chunk_ = chunks_.size();
+  } else {
+    it.chunk_ = std::upper_bound(offsets_.begin(), offsets_.end(), index) - offsets_.begin() - 1;
+    it.offset_ = index - offsets_[it.chunk_];
+  }
+  return it;
+}
+
+void CanEventList::updateOffsets() {
+  offsets_.resize(chunks_.size());
+  size_ = 0;
+  for (size_t i = 0; i < chunks_.size(); ++i) {
+    offsets_[i] = size_;
+    size_ += chunks_[i].size();
+  }
+}
+
+// CanEventStore
+
+CanEvent *CanEventStore::allocate(uint64_t mono_time, size_t dat_size) {
+  const size_t size = (sizeof(CanEvent) + dat_size + alignof(CanEvent) - 1) & ~(alignof(CanEvent) - 1);
+  std::lock_guard lk(mutex_);
+  if (chunks_.empty() || chunks_.back().used + size > CHUNK_SIZE) {
+    chunks_.push_back({.data = std::unique_ptr<uint8_t[]>(new uint8_t[CHUNK_SIZE])});
+  }
+  auto &chunk = chunks_.back();
+  CanEvent *e = (CanEvent *)(chunk.data.get() + chunk.used);
+  chunk.used += size;
+  chunk.max_mono_time = std::max(chunk.max_mono_time, mono_time);
+  return e;
+}
+
+uint64_t CanEventStore::evict(uint64_t min_mono_time, size_t max_bytes) {
+  std::lock_guard lk(mutex_);
+  uint64_t evicted_ts = 0;
+  while (chunks_.size() > 1 &&
+         (chunks_.front().max_mono_time < min_mono_time || chunks_.size() * CHUNK_SIZE > max_bytes)) {
+    evicted_ts = std::max(evicted_ts, chunks_.front().max_mono_time);
+    chunks_.pop_front();
+  }
+  return evicted_ts;
+}
+
+// SignalCache
+
+static bool sameLayout(const cabana::Signal &a, const cabana::Signal &b) {
+  return a.start_bit == b.start_bit && a.size == b.size && a.is_signed == b.is_signed &&
+         a.is_little_endian == b.is_little_endian && a.factor == b.factor && a.offset == b.offset;
+}
+
+template <class Iter>
+void SignalCache::decode(const cabana::SignalDecoder &decoder, Iter first, Iter last, SignalSeries::Chunk &chunk) {
+  chunk.values.resize(last - first);
+  decoder.decode(first, last, chunk.values.data());
+  chunk.mono_times.reserve(chunk.values.size());
+  for (auto it = first; it != last; ++it) {
+    chunk.mono_times.push_back((*it)->mono_time);
+  }
+}
+
+std::shared_ptr<const SignalSeries> SignalCache::get(const MessageId &id, const cabana::Signal *sig,
+                                                     const CanEventList &events) {
+  std::shared_ptr<Entry> entry;
+  {
+    std::lock_guard lk(mutex_);
+    auto &e = entries_[{id, sig}];
+    if (!e) e = std::make_shared<Entry>();
+    entry = e;
+  }
+
+  std::lock_guard lk(entry->mutex);
+  auto series = entry->series.lock();
+  bool valid = series && series->size() == events.size() && sameLayout(entry->sig, *sig) &&
+               (entry->sig.multiplexor != nullptr) == (sig->multiplexor != nullptr);
+  if (valid && sig->multiplexor) {
+    valid = entry->sig.multiplex_value == sig->multiplex_value && sameLayout(entry->multiplexor, *sig->multiplexor);
+  }
+  if (!valid) {
+    // keep copies of the layouts, the signals may be edited or removed
+    entry->sig = *sig;
+    if (sig->multiplexor) {
+      entry->multiplexor = *sig->multiplexor;
+      entry->sig.multiplexor = &entry->multiplexor;
+    }
+    entry->decoder.emplace(entry->sig);
+    // decoded in the chunks of the events, which later merges keep alike
+    series = std::make_shared<SignalSeries>();
+    for (const auto &events_chunk : events.chunks()) {
+      if (events_chunk.empty()) continue;
+      decode(*entry->decoder, events_chunk.cbegin(), events_chunk.cend(), series->chunks_.emplace_back());
+    }
+    series->updateOffsets();
+    entry->series = series;
+  }
+  return series;
+}
+
+void SignalCache::merge(const MessageEventsMap &new_events) {
+  std::lock_guard lk(mutex_);
+  removeReleased();
+  for (const auto &[id, events] : new_events) {
+    if (events.empty()) continue;
+
+    for (auto it = entries_.lower_bound({id, nullptr}); it != entries_.end() && it->first.first == id; ++it) {
+      auto &entry = it->second;
+      std::lock_guard entry_lk(entry->mutex);
+      auto series = entry->series.lock();
+      if (!series) continue;
+
+      SignalSeries::Chunk chunk;
+      decode(*entry->decoder, events.cbegin(), events.cend(), chunk);
+      series->merge(std::move(chunk));
+    }
+  }
+}
+
+void SignalCache::evict(uint64_t evicted_ts) {
+  std::lock_guard lk(mutex_);
+  removeReleased();
+  for (auto &[_, entry] : entries_) {
+    std::lock_guard entry_lk(entry->mutex);
+    if (auto series = entry->series.lock()) {
+      series->eraseUntil(evicted_ts);
+    }
+  }
+}
+
+// drops the entries of the series no view holds anymore, unless get() is using them
+void SignalCache::removeReleased() {
+  for (auto it = entries_.begin(); it != entries_.end(); /**/) {
+    bool released = false;
+    if (it->second.use_count() == 1) {
+      std::lock_guard entry_lk(it->second->mutex);
+      released = it->second->series.expired();
+    }
+    it = released ? entries_.erase(it) : std::next(it);
+  }
+}
+
+size_t SignalCache::size() {
+  std::lock_guard lk(mutex_);
+  removeReleased();
+  return entries_.size();
+}
+
+void SignalCache::remove(std::function<bool(const MessageId &id, const cabana::Signal *sig)> predicate) {
+  std::lock_guard lk(mutex_);
+  for (auto it = entries_.begin(); it != entries_.end(); /**/) {
+    it = predicate(it->first.first, it->first.second) ? entries_.erase(it) : std::next(it);
+  }
+}
+
+// SignalSeries
+
+void SignalSeries::merge(Chunk &&chunk) {
+  if (chunk.values.empty()) return;
+
+  // same as CanEventList::merge(), chunks with values in (first_ts, last_ts] interleave with the new values
+  const uint64_t first_ts = chunk.mono_times.front(), last_ts = chunk.mono_times.back();
+  auto first = std::partition_point(chunks_.begin(), chunks_.end(), [=](auto &c) { return c.mono_times.back() <= first_ts; });
+  auto last = std::partition_point(first, chunks_.end(), [=](auto &c) { return c.mono_times.front() <= last_ts; });
+  if (first == last) {
+    if (first == chunks_.end() && !chunks_.empty() && chunks_.back().values.size() < MAX_APPEND_CHUNK_SIZE) {
+      auto &back = chunks_.back();
+      back.mono_times.insert(back.mono_times.end(), chunk.mono_times.begin(), chunk.mono_times.end());
+      back.values.insert(back.values.end(), chunk.values.begin(), chunk.values.end());
+    } else {
+      chunks_.insert(first, std::move(chunk));
+    }
+  } else {
+    size_t merged_size = chunk.values.size();
+    for (auto it = first; it != last; ++it) merged_size += it->values.size();
+    Chunk merged;
+    merged.mono_times.reserve(merged_size);
+    merged.values.reserve(merged_size);
+    size_t j = 0;
+    for (auto it = first; it != last; ++it) {
+      for (size_t i = 0; i < it->values.size(); ++i) {
+        for (; j < chunk.values.size() && chunk.mono_times[j] < it->mono_times[i]; ++j) {
+          merged.mono_times.push_back(chunk.mono_times[j]);
+          merged.values.push_back(chunk.values[j]);
+        }
+        merged.mono_times.push_back(it->mono_times[i]);
+        merged.values.push_back(it->values[i]);
+      }
+    }
+    merged.mono_times.insert(merged.mono_times.end(), chunk.mono_times.begin() + j, chunk.mono_times.end());
+    merged.values.insert(merged.values.end(), chunk.values.begin() + j, chunk.values.end());
+    *first = std::move(merged);
+    chunks_.erase(first + 1, last);
+  }
+  updateOffsets();
+}
+
+void SignalSeries::eraseUntil(uint64_t mono_time) {
+  auto last = std::partition_point(chunks_.begin(), chunks_.end(), [=](auto &c) { return c.mono_times.back() <= mono_time; });
+  chunks_.erase(chunks_.begin(), last);
+  if (!chunks_.empty()) {
+    auto &c = chunks_.front();
+    const size_t n = std::upper_bound(c.mono_times.begin(), c.mono_times.end(), mono_time) - c.mono_times.begin();
+    c.mono_times.erase(c.mono_times.begin(), c.mono_times.begin() + n);
+    c.values.erase(c.values.begin(), c.values.begin() + n);
+  }
+  updateOffsets();
+}
+
+size_t SignalSeries::lowerBound(uint64_t mono_time) const {
+  auto c = std::partition_point(chunks_.begin(), chunks_.end(), [=](auto &c) { return c.mono_times.back() < mono_time; });
+  if (c == chunks_.end()) return size_;
+  return offsets_[c - chunks_.begin()] + (std::lower_bound(c->mono_times.begin(), c->mono_times.end(), mono_time) - c->mono_times.begin());
+}
+
+size_t SignalSeries::upperBound(uint64_t mono_time) const {
+  auto c = std::partition_point(chunks_.begin(), chunks_.end(), [=](auto &c) { return c.mono_times.back() <= mono_time; });
+  if (c == chunks_.end()) return size_;
+  return offsets_[c - chunks_.begin()] + (std::upper_bound(c->mono_times.begin(), c->mono_times.end(), mono_time) - c->mono_times.begin());
+}
+
+std::pair<size_t, size_t> SignalSeries::locate(size_t i) const {
+  const size_t c = std::upper_bound(offsets_.begin(), offsets_.end(), i) - offsets_.begin() - 1;
+  return {c, i - offsets_[c]};
+}
+
+void SignalSeries::updateOffsets() {
+  offsets_.resize(chunks_.size());
+  size_ = 0;
+  for (size_t i = 0; i < chunks_.size(); ++i) {
+    offsets_[i] = size_;
+    size_ += chunks_[i].values.size();
+  }
+}
+
 namespace {
 
 enum Color { GREYISH_BLUE, CYAN, RED};
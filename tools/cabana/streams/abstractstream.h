@@ -3,6 +3,10 @@
 #include <algorithm>
 #include <array>
 #include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <optional>
@@ -53,8 +57,187 @@ struct CompareCanEvent {
   constexpr bool operator()(uint64_t ts, const CanEvent *const e) const { return ts < e->mono_time; }
 };
 
+// Allocates CanEvents in chunks, so live streams can free the oldest events a chunk at a time
+class CanEventStore {
+public:
+  CanEvent *allocate(uint64_t mono_time, size_t dat_size);
+  // frees the oldest chunks that only hold events before min_mono_time, then the oldest ones beyond max_bytes.
+  // the chunk currently allocated from is kept. returns the latest mono_time of the freed events, or 0.
+  uint64_t evict(uint64_t min_mono_time, size_t max_bytes);
+
+private:
+  struct Chunk {
+    std::unique_ptr<uint8_t[]> data;
+    size_t used = 0;
+    uint64_t max_mono_time = 0;
+  };
+  static constexpr size_t CHUNK_SIZE = 6 * 1024 * 1024;  // 6MB
+  std::mutex mutex_;
+  std::deque<Chunk> chunks_;
+};
+
+// Sorted CanEvents stored as a sorted list of chunks, e.g. one per replay segment.
+// Merging events that do not overlap the existing ones only copies the new events.
+class CanEventList {
+public:
+  class const_iterator {
+  public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = const CanEvent *;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const value_type *;
+    using reference = const value_type &;
+
+    const_iterator() = default;
+    inline reference operator*() const { return list_->chunks_[chunk_][offset_]; }
+    inline pointer operator->() const { return &**this; }
+    inline reference operator[](difference_type n) const { return *(*this + n); }
+    inline const_iterator &operator++() {
+      if (++offset_ == list_->chunks_[chunk_].size()) {
+        ++chunk_;
+        offset_ = 0;
+      }
+      ++index_;
+      return *this;
+    }
+    inline const_iterator &operator--() {
+      if (offset_ == 0) offset_ = list_->chunks_[--chunk_].size();
+      --offset_;
+      --index_;
+      return *this;
+    }
+    inline const_iterator operator++(int) { auto it = *this; ++*this; return it; }
+    inline const_iterator operator--(int) { auto it = *this; --*this; return it; }
+    inline const_iterator &operator+=(difference_type n) {
+      if (chunk_ < list_->chunks_.size() && offset_ + n < list_->chunks_[chunk_].size()) {
+        offset_ += n;  // within the chunk, also for negative n
+        index_ += n;
+      } else {
+        *this = list_->iteratorAt(index_ + n);
+      }
+      return *this;
+    }
+    inline const_iterator &operator-=(difference_type n) { return *this += -n; }
+    inline const_iterator operator+(difference_type n) const { auto it = *this; return it += n; }
+    inline const_iterator operator-(difference_type n) const { auto it = *this; return it -= n; }
+    friend inline const_iterator operator+(difference_type n, const const_iterator &it) { return it + n; }
+    inline difference_type operator-(const const_iterator &other) const { return (difference_type)index_ - (difference_type)other.index_; }
+    inline bool operator==(const const_iterator &other) const { return index_ == other.index_; }
+    inline bool operator!=(const const_iterator &other) const { return index_ != other.index_; }
+    inline bool operator<(const const_iterator &other) const { return index_ < other.index_; }
+    inline bool operator>(const const_iterator &other) const { return index_ > other.index_; }
+    inline bool operator<=(const const_iterator &other) const { return index_ <= other.index_; }
+    inline bool operator>=(const const_iterator &other) const { return index_ >= other.index_; }
+
+  private:
+    friend class CanEventList;
+    const CanEventList *list_ = nullptr;
+    size_t chunk_ = 0, offset_ = 0, index_ = 0;
+  };
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+  // events must be sorted. on equal times, existing events go first
+  void merge(const std::vector<const CanEvent *> &events);
+  // removes the events at or before mono_time
+  void eraseUntil(uint64_t mono_time);
+
+  inline size_t size() const { return size_; }
+  inline bool empty() const { return size_ == 0; }
+  inline const CanEvent *front() const { return chunks_.front().front(); }
+  inline const CanEvent *back() const { return chunks_.back().back(); }
+  inline const CanEvent *operator[](size_t i) const { return *iteratorAt(i); }
+  inline const_iterator begin() const { return iteratorAt(0); }
+  inline const_iterator end() const { return iteratorAt(size_); }
+  inline const_iterator cbegin() const { return begin(); }
+  inline const_iterator cend() const { return end(); }
+  inline const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+  inline const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+  inline const std::vector<std::vector<const CanEvent *>> &chunks() const { return chunks_; }
+
+private:
+  const_iterator iteratorAt(size_t index) const;
+  void updateOffsets();
+
+  // appending to the last chunk up to this size keeps live streams from creating a chunk per update
+  static constexpr size_t MAX_APPEND_CHUNK_SIZE = 64 * 1024;
+  std::vector<std::vector<const CanEvent *>> chunks_;  // never empty
+  std::vector<size_t> offsets_;                         // index of the first event of each chunk
+  size_t size_ = 0;
+};
+
 typedef std::unordered_map<MessageId, std::vector<const CanEvent *>> MessageEventsMap;
-using CanEventIter = std::vector<const CanEvent *>::const_iterator;
+typedef std::unordered_map<MessageId, CanEventList> CanEventsMap;
+using CanEventIter = CanEventList::const_iterator;
+
+// Decoded values of a signal, one per event of its message. NaN where the multiplexor does not match.
+// Stored in sorted chunks like the events of its CanEventList, so merging only copies the overlapped chunks.
+class SignalSeries {
+public:
+  struct Chunk {
+    std::vector<uint64_t> mono_times;
+    std::vector<double> values;
+  };
+
+  inline size_t size() const { return size_; }
+  inline bool empty() const { return size_ == 0; }
+  inline uint64_t monoTime(size_t i) const { auto [c, o] = locate(i); return chunks_[c].mono_times[o]; }
+  inline double value(size_t i) const { auto [c, o] = locate(i); return chunks_[c].values[o]; }
+  // index of the first value at or after mono_time, and after mono_time
+  size_t lowerBound(uint64_t mono_time) const;
+  size_t upperBound(uint64_t mono_time) const;
+  // calls f(mono_time, value) for the values [first, last) in order
+  template <class F>
+  void forEach(size_t first, size_t last, F f) const {
+    if (first >= last) return;
+    auto [c, o] = locate(first);
+    for (size_t n = last - first; n > 0; ++c, o = 0) {
+      const Chunk &chunk = chunks_[c];
+      const size_t end = std::min(chunk.values.size(), o + n);
+      for (size_t i = o; i < end; ++i) f(chunk.mono_times[i], chunk.values[i]);
+      n -= end - o;
+    }
+  }
+
+private:
+  friend class SignalCache;
+  // values must be sorted. on equal times, existing values go first
+  void merge(Chunk &&chunk);
+  // removes the values at or before mono_time
+  void eraseUntil(uint64_t mono_time);
+  std::pair<size_t, size_t> locate(size_t i) const;  // chunk and offset of value i
+  void updateOffsets();
+
+  static constexpr size_t MAX_APPEND_CHUNK_SIZE = 64 * 1024;  // same as CanEventList
+  std::vector<Chunk> chunks_;
+  std::vector<size_t> offsets_;
+  size_t size_ = 0;
+};
+
+// Decodes each signal once for the charts, sparklines and history logs. Series are decoded on first use,
+// then updated in place along with the events, so they are only read on the ui thread or while it waits.
+// The views hold the series they show, a series is freed once no view holds it.
+class SignalCache {
+public:
+  std::shared_ptr<const SignalSeries> get(const MessageId &id, const cabana::Signal *sig, const CanEventList &events);
+  void merge(const MessageEventsMap &new_events);
+  void evict(uint64_t evicted_ts);
+  void remove(std::function<bool(const MessageId &id, const cabana::Signal *sig)> predicate);
+  size_t size();
+
+private:
+  struct Entry {
+    std::mutex mutex;
+    cabana::Signal sig, multiplexor;  // layouts the series was decoded with
+    std::optional<cabana::SignalDecoder> decoder;
+    std::weak_ptr<SignalSeries> series;
+  };
+  void removeReleased();
+  template <class Iter>
+  static void decode(const cabana::SignalDecoder &decoder, Iter first, Iter last, SignalSeries::Chunk &chunk);
+
+  std::mutex mutex_;
+  std::map<std::pair<MessageId, const cabana::Signal *>, std::shared_ptr<Entry>> entries_;
+};
 
 class AbstractStream : public QObject {
   Q_OBJECT
@@ -84,11 +267,18 @@ public:
 
   inline const std::unordered_map<MessageId, CanData> &lastMessages() const { return last_msgs; }
   bool isMessageActive(const MessageId &id) const;
-  inline const MessageEventsMap &eventsMap() const { return events_; }
-  inline const std::vector<const CanEvent *> &allEvents() const { return all_events_; }
+  inline const CanEventsMap &eventsMap() const { return events_; }
+  inline const CanEventList &allEvents() const { return all_events_; }
   const CanData &lastMessage(const MessageId &id) const;
-  const std::vector<const CanEvent *> &events(const MessageId &id) const;
+  const CanEventList &events(const MessageId &id) const;
   std::pair<CanEventIter, CanEventIter> eventsInRange(const MessageId &id, std::optional<std::pair<double, double>> time_range) const;
+  // events stay valid while held, e.g. by background searches over a copy of allEvents()
+  inline void holdEvents(bool hold) { event_holds_ += hold ? 1 : -1; }
+  // also called on worker threads while the ui thread waits, the events are only changed on the ui thread.
+  // the series is updated along with the events while it is held.
+  inline std::shared_ptr<const SignalSeries> signalSeries(const MessageId &id, const cabana::Signal *sig) {
+    return signal_cache_.get(id, sig, events(id));
+  }
 
   size_t suppressHighlighted();
   void clearSuppressed();
@@ -101,6 +291,7 @@ signals:
   void seekedTo(double sec);
   void timeRangeChanged(const std::optional<std::pair<double, double>> &range);
   void eventsMerged(const MessageEventsMap &events_map);
+  void eventsEvicted(double min_sec);
   void msgsReceived(const std::set<MessageId> *new_msgs, bool has_new_ids);
   void sourcesUpdated(const SourceSet &s);
   void privateUpdateLastMsgsSignal();
@@ -110,10 +301,12 @@ public:
 
 protected:
   void mergeEvents(const std::vector<const CanEvent *> &events);
+  // frees events before min_mono_time, or beyond max_bytes, and removes them from the index
+  void evictEvents(uint64_t min_mono_time, size_t max_bytes);
   const CanEvent *newEvent(uint64_t mono_time, const cereal::CanData::Reader &c);
   void updateEvent(const MessageId &id, double sec, const uint8_t *data, uint8_t size);
   void waitForSeekFinshed();
-  std::vector<const CanEvent *> all_events_;
+  CanEventList all_events_;
   double current_sec_ = 0;
   std::optional<std::pair<double, double>> time_range_;
 
@@ -122,9 +315,11 @@ private:
   void updateLastMsgsTo(double sec);
   void updateMasks();
 
-  MessageEventsMap events_;
+  CanEventsMap events_;
   std::unordered_map<MessageId, CanData> last_msgs;
-  std::unique_ptr<MonotonicBuffer> event_buffer_;
+  CanEventStore event_store_;
+  SignalCache signal_cache_;
+  int event_holds_ = 0;
 
   // Members accessed in multiple threads. (mutex protected)
   std::mutex mutex_;
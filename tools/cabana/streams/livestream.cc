@@ -94,9 +94,15 @@ void LiveStream::timerEvent(QTimerEvent *event) {
       uint64_t last_received_ts = !received_events_.empty() ? received_events_.back()->mono_time : 0;
       lastest_event_ts = std::max(lastest_event_ts, last_received_ts);
       received_events_.clear();
+
+      // all received events are merged, so their chunks can be freed
+      const uint64_t retention = settings.max_cached_minutes * 60 * 1e9;
+      evictEvents(lastest_event_ts > retention ? lastest_event_ts - retention : 0,
+                  (size_t)settings.max_cached_mb * 1024 * 1024);
     }
     if (!all_events_.empty()) {
-      begin_event_ts = all_events_.front()->mono_time;
+      // keep the time axis when old events are evicted
+      if (begin_event_ts == 0) begin_event_ts = all_events_.front()->mono_time;
       updateEvents();
       return;
     }
@@ -135,7 +141,7 @@ void LiveStream::updateEvents() {
 }
 
 void LiveStream::seekTo(double sec) {
-  sec = std::max(0.0, sec);
+  sec = std::max(minSeconds(), sec);
   first_update_ts = nanos_since_boot();
   current_event_ts = first_event_ts = std::min<uint64_t>(sec * 1e9 + begin_event_ts, lastest_event_ts);
   post_last_event = (first_event_ts == lastest_event_ts);
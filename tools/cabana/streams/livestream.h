@@ -18,6 +18,8 @@ public:
   void stop();
   inline QDateTime beginDateTime() const { return begin_date_time; }
   inline uint64_t beginMonoTime() const override { return begin_event_ts; }
+  // older events are evicted, see Settings::max_cached_minutes and max_cached_mb
+  double minSeconds() const override { return !all_events_.empty() ? toSeconds(all_events_.front()->mono_time) : 0; }
   double maxSeconds() const override { return std::max(1.0, (lastest_event_ts - begin_event_ts) / 1e9); }
   void setSpeed(float speed) override { speed_ = speed; }
   double getSpeed() override { return speed_; }
@@ -26,7 +26,8 @@ ReplayStream::ReplayStream(QObject *parent) : AbstractStream(parent) {
 void ReplayStream::mergeSegments() {
   auto event_data = replay->getEventData();
   for (const auto &[n, seg] : event_data->segments) {
-    if (!processed_segments.count(n)) {
+    // partially loaded segments are processed once their log is complete
+    if (!processed_segments.count(n) && !event_data->isSegmentPartial(n)) {
       processed_segments.insert(n);
 
       std::vector<const CanEvent *> new_events;
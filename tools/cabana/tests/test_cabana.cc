@@ -1,9 +1,19 @@
 
 #undef INFO
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <random>
+#include <tuple>
+
 #include <QDir>
 
 #include "catch2/catch.hpp"
 #include "tools/cabana/dbc/dbcmanager.h"
+#include "tools/cabana/streams/abstractstream.h"
+#include "tools/cabana/tools/bitcorrelation.h"
+#include "tools/cabana/tools/signalindex.h"
+#include "tools/cabana/utils/util.h"
 
 const std::string TEST_RLOG_URL = "https://commadataci.blob.core.windows.net/openpilotci/0c94aa1e1296d7c6/2021-05-05--19-48-37/0/rlog.bz2";
 
@@ -155,3 +165,358 @@ TEST_CASE("parse_opendbc") {
   INFO(errors.join("\n").toStdString());
   REQUIRE(errors.empty());
 }
+
+TEST_CASE("SignalDecoder") {
+  std::vector<std::array<uint8_t, 16>> data(64);
+  for (auto &dat : data) {
+    for (auto &b : dat) b = rand();
+  }
+
+  for (bool little_endian : {true, false}) {
+    for (bool is_signed : {true, false}) {
+      for (int size = 1; size < 64; ++size) {
+        for (int start_bit = 0; start_bit < 128; ++start_bit) {
+          cabana::Signal sig = {};
+          sig.start_bit = start_bit;
+          sig.size = size;
+          sig.is_little_endian = little_endian;
+          sig.is_signed = is_signed;
+          sig.factor = 0.5;
+          sig.offset = -10;
+          updateMsbLsb(sig);
+          if (sig.lsb < 0 || sig.msb >= 128) continue;
+
+          const cabana::SignalDecoder decoder(sig);
+          for (int i = 0; i < data.size(); ++i) {
+            // also cover data shorter than the signal
+            const size_t data_size = i % data[i].size() + 1;
+            REQUIRE(decoder.value(data[i].data(), data_size) == get_raw_value(data[i].data(), data_size, sig));
+          }
+        }
+      }
+    }
+  }
+
+  SECTION("multiplexed signals") {
+    DBCFile file("", R"(
+BO_ 162 message_1: 8 XXX
+  SG_ signal_1 M : 0|12@1+ (1,0) [0|4095] "unit" XXX
+  SG_ signal_2 M4 : 12|4@1+ (1.0,0.0) [0.0|15] "" XXX
+)");
+    struct Event {
+      uint8_t size = 2;
+      uint8_t dat[2];
+    } events[] = {{.dat = {4, 0x30}}, {.dat = {5, 0x30}}};
+    const Event *event_ptrs[] = {&events[0], &events[1]};
+
+    double values[2] = {};
+    cabana::SignalDecoder(*file.msg(162)->sigs[1]).decode(std::begin(event_ptrs), std::end(event_ptrs), values);
+    REQUIRE(values[0] == 3);
+    REQUIRE(std::isnan(values[1]));
+  }
+}
+
+TEST_CASE("SignalCache") {
+  DBCFile file("", R"(
+BO_ 160 message_1: 1 XXX
+  SG_ signal_1 : 0|8@1+ (1,0) [0|255] "" XXX
+)");
+  cabana::Signal *sig = file.msg(160)->sigs[0];
+  const MessageId id = {.source = 0, .address = 160};
+
+  CanEventStore store;
+  auto new_events = [&](std::vector<uint64_t> mono_times) {
+    std::vector<const CanEvent *> events;
+    for (auto t : mono_times) {
+      CanEvent *e = store.allocate(t, 1);
+      e->src = 0;
+      e->address = 160;
+      e->mono_time = t;
+      e->size = 1;
+      e->dat[0] = t;
+      events.push_back(e);
+    }
+    return events;
+  };
+
+  auto values = [](const SignalSeries &series) {
+    std::vector<double> v;
+    series.forEach(0, series.size(), [&](uint64_t, double value) { v.push_back(value); });
+    return v;
+  };
+
+  SignalCache cache;
+  CanEventList events;
+  events.merge(new_events({10, 20, 50}));
+  auto series = cache.get(id, sig, events);
+  REQUIRE(values(*series) == std::vector<double>{10, 20, 50});
+
+  // merged into the cached series in the same order as the events, before, between and after them
+  for (auto mono_times : std::vector<std::vector<uint64_t>>{{20, 30, 60}, {1, 2}, {70, 80}, {3, 4}, {65, 90}}) {
+    MessageEventsMap new_events_map = {{id, new_events(mono_times)}};
+    events.merge(new_events_map[id]);
+    cache.merge(new_events_map);
+  }
+  REQUIRE(series->size() == events.size());
+  for (int i = 0; i < events.size(); ++i) {
+    REQUIRE(series->monoTime(i) == events[i]->mono_time);
+    REQUIRE(series->value(i) == events[i]->dat[0]);
+  }
+  REQUIRE(series->lowerBound(20) == 5);
+  REQUIRE(series->upperBound(20) == 7);
+  REQUIRE(series->lowerBound(100) == series->size());
+  SignalCache decoded_cache;
+  REQUIRE(values(*series) == values(*decoded_cache.get(id, sig, events)));
+
+  events.eraseUntil(20);
+  cache.evict(20);
+  REQUIRE(values(*series) == std::vector<double>{30, 50, 60, 65, 70, 80, 90});
+
+  // decoded again after the signal is edited
+  sig->factor = 2;
+  REQUIRE(values(*cache.get(id, sig, events)) == std::vector<double>{60, 100, 120, 130, 140, 160, 180});
+
+  // freed and evicted once released
+  std::weak_ptr<const SignalSeries> released = series;
+  series = cache.get(id, sig, events);
+  REQUIRE(released.expired());
+  REQUIRE(cache.size() == 1);
+  series.reset();
+  cache.merge({{id, new_events({100})}});
+  REQUIRE(cache.size() == 0);
+}
+
+TEST_CASE("CanEventList") {
+  CanEventStore store;
+  auto new_events = [&](uint64_t first, uint64_t last) {
+    std::vector<const CanEvent *> events;
+    for (uint64_t t = first; t < last; ++t) {
+      CanEvent *e = store.allocate(t, 0);
+      e->mono_time = t;
+      events.push_back(e);
+    }
+    return events;
+  };
+
+  CanEventList list;
+  // segments loaded out of order
+  list.merge(new_events(200, 300));
+  list.merge(new_events(0, 100));
+  list.merge(new_events(300, 400));
+  list.merge(new_events(100, 200));
+  // overlapping events are interleaved
+  list.merge(new_events(350, 360));
+  REQUIRE(list.size() == 410);
+  REQUIRE(std::is_sorted(list.begin(), list.end(), [](auto l, auto r) { return l->mono_time < r->mono_time; }));
+  REQUIRE(list.front()->mono_time == 0);
+  REQUIRE(list.back()->mono_time == 399);
+
+  auto it = std::lower_bound(list.begin(), list.end(), 150, CompareCanEvent());
+  REQUIRE(it - list.begin() == 150);
+  REQUIRE((*it)->mono_time == 150);
+  REQUIRE((*(it + 100))->mono_time == 250);
+  REQUIRE((*std::prev(list.end()))->mono_time == 399);
+  REQUIRE(std::distance(list.rbegin(), list.rend()) == 410);
+
+  list.eraseUntil(249);
+  REQUIRE(list.size() == 160);
+  REQUIRE(list.front()->mono_time == 250);
+  REQUIRE(list[0]->mono_time == 250);
+}
+
+TEST_CASE("BitCorrelation") {
+  CanEventStore store;
+  std::vector<const CanEvent *> events;
+  auto add_event = [&](uint8_t src, uint32_t address, std::vector<uint8_t> dat) {
+    CanEvent *e = store.allocate(events.size(), dat.size());
+    e->src = src;
+    e->address = address;
+    e->mono_time = events.size();
+    e->size = dat.size();
+    memcpy(e->dat, dat.data(), dat.size());
+    events.push_back(e);
+  };
+
+  // target: bus 0, 0x100, byte 0, bit 0 (msb). 0x200 on bus 1 copies it to byte 1 bit 7 (lsb)
+  add_event(1, 0x200, {0x00, 0x00});  // before the first target message
+  for (int i = 0; i < 1000; ++i) {
+    const uint8_t target_bit = (i / 3) % 2;
+    add_event(0, 0x100, {(uint8_t)(target_bit << 7)});
+    add_event(1, 0x200, {0xff, target_bit});
+  }
+  CanEventList list;
+  list.merge(events);
+
+  std::atomic<bool> canceled = false;
+  auto result = BitCorrelation::compute(list, {.bus = 0, .address = 0x100, .byte_idx = 0, .bit_idx = 0}, 1, canceled);
+  REQUIRE(result.size() == 1);
+  auto &stats = result[0x200];
+  REQUIRE(stats.count == 1001);
+  REQUIRE(stats.same.size() == 16);
+  REQUIRE(stats.same[15] == 1000);
+  REQUIRE(stats.differ[15] == 0);
+  REQUIRE(stats.same[0] + stats.differ[0] == 1000);
+}
+
+TEST_CASE("SignalIndex") {
+  CanEventStore store;
+  std::vector<const CanEvent *> events;
+  // a big endian counter in bytes 2-3 and a flag in byte 7 that is set once, over several blocks
+  const int num_events = SignalIndex::BLOCK_SIZE * 3 + 100;
+  for (int i = 0; i < num_events; ++i) {
+    CanEvent *e = store.allocate(i, 8);
+    e->src = 0;
+    e->address = 0x100;
+    e->mono_time = i + 1;
+    e->size = i == 10 ? 2 : 8;  // short message without the counter
+    uint8_t dat[8] = {0x12, 0x34, (uint8_t)(i >> 8), (uint8_t)i, 0, 0, 0, (uint8_t)(i >= 9000)};
+    memcpy(e->dat, dat, e->size);
+    events.push_back(e);
+  }
+  CanEventList list;
+  list.merge(events);
+
+  const MessageId id = {.source = 0, .address = 0x100};
+  SignalIndex index;
+  index.append(id, list.begin(), list.begin() + 5000);
+  index.append(id, list.begin() + 5000, list.end());
+  REQUIRE(index.lastTime(id) == num_events);
+
+  auto make_signal = [](int start_bit, int size, bool little_endian, double factor = 1.0) {
+    cabana::Signal sig{};
+    sig.start_bit = start_bit;
+    sig.size = size;
+    sig.is_little_endian = little_endian;
+    sig.factor = factor;
+    updateMsbLsb(sig);
+    return sig;
+  };
+  const auto counter = make_signal(23, 16, false, 0.5);
+  const auto flag = make_signal(56, 1, true);
+
+  auto matches = index.search({{id, 0, counter}, {id, 9000, counter}, {id, 0, flag}}, {.op = SignalIndex::EQUAL, .v1 = 4242.5});
+  REQUIRE(matches[0].found);
+  REQUIRE(matches[0].mono_time == 8486);
+  REQUIRE(matches[0].value == 4242.5);
+  REQUIRE_FALSE(matches[1].found);  // searches after mono_time
+  REQUIRE_FALSE(matches[2].found);
+
+  matches = index.search({{id, 0, counter}, {id, 0, flag}}, {.op = SignalIndex::CHANGED});
+  REQUIRE(matches[0].mono_time == 2);
+  REQUIRE(matches[1].mono_time == 9001);
+  REQUIRE(matches[1].value == 1);
+
+  // same as decoding each event, including the short message
+  for (const auto &sig : {make_signal(3, 61, true), make_signal(7, 64, false), make_signal(12, 20, true), make_signal(31, 3, false)}) {
+    const cabana::SignalDecoder decoder(sig);
+    for (auto op : {SignalIndex::GREATER, SignalIndex::LESS_EQUAL, SignalIndex::BETWEEN}) {
+      SignalIndex::Query query{.op = op, .v1 = decoder.value(events[5]->dat, 8), .v2 = decoder.value(events[20]->dat, 8)};
+      auto m = index.search({{id, 0, sig}}, query)[0];
+      auto it = std::find_if(events.begin(), events.end(), [&](const CanEvent *e) {
+        double v = decoder.value(e->dat, e->size);
+        return op == SignalIndex::GREATER ? v > query.v1 : op == SignalIndex::LESS_EQUAL ? v <= query.v1 : v >= query.v1 && v <= query.v2;
+      });
+      REQUIRE(m.found == (it != events.end()));
+      if (m.found) {
+        REQUIRE(m.mono_time == (*it)->mono_time);
+        REQUIRE(m.value == decoder.value((*it)->dat, (*it)->size));
+      }
+    }
+  }
+}
+
+TEST_CASE("SignalIndex::update") {
+  CanEventStore store;
+  auto new_events = [&](uint64_t first, uint64_t last) {
+    std::vector<const CanEvent *> events;
+    for (uint64_t t = first; t < last; ++t) {
+      CanEvent *e = store.allocate(t, 1);
+      e->src = 0;
+      e->address = 0x100;
+      e->mono_time = t;
+      e->size = 1;
+      e->dat[0] = t;
+      events.push_back(e);
+    }
+    return events;
+  };
+
+  cabana::Signal sig{};
+  sig.start_bit = 0;
+  sig.size = 8;
+  sig.is_little_endian = true;
+  sig.factor = 1;
+  updateMsbLsb(sig);
+  const MessageId id = {.source = 0, .address = 0x100};
+
+  CanEventList list;
+  list.merge(new_events(100, 200));
+  SignalIndex index;
+  index.update(id, list.begin(), list.end());
+  REQUIRE_FALSE(index.search({{id, 0, sig}}, {.op = SignalIndex::EQUAL, .v1 = 50})[0].found);
+
+  // new events are appended
+  list.merge(new_events(200, 250));
+  index.update(id, list.begin(), list.end());
+  REQUIRE(index.lastTime(id) == 249);
+
+  // an earlier segment is merged after the first search
+  list.merge(new_events(1, 100));
+  index.update(id, list.begin(), list.end());
+  auto m = index.search({{id, 0, sig}}, {.op = SignalIndex::EQUAL, .v1 = 50})[0];
+  REQUIRE(m.found);
+  REQUIRE(m.mono_time == 50);
+  m = index.search({{id, 0, sig}}, {.op = SignalIndex::EQUAL, .v1 = 220})[0];
+  REQUIRE(m.mono_time == 220);
+  REQUIRE(index.lastTime(id) == 249);
+}
+
+TEST_CASE("MinMaxPyramid") {
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> dist(-100, 100);
+  std::vector<QPointF> arr;
+  for (int i = 0; i < 10000; ++i) {
+    arr.emplace_back(i, dist(gen));
+  }
+  MinMaxPyramid pyramid;
+  pyramid.build(arr);
+
+  for (auto [first, last, max_points] : std::vector<std::tuple<int, int, int>>{{0, 10000, 200}, {123, 9876, 300}, {5, 1030, 64}, {4000, 4100, 400}, {9990, 10000, 4}}) {
+    std::vector<QPointF> points;
+    pyramid.decimate(arr, first, last, max_points, points);
+    if (last - first <= max_points) {
+      REQUIRE(points.size() == last - first);
+      continue;
+    }
+    // two partial buckets and the end points may exceed max_points
+    REQUIRE(points.size() <= max_points + 6);
+    REQUIRE(std::is_sorted(points.begin(), points.end(), [](auto &l, auto &r) { return l.x() < r.x(); }));
+
+    // the edges of the range are kept and no point outside of it is added
+    REQUIRE(points.front() == arr[first]);
+    REQUIRE(points.back() == arr[last - 1]);
+    // the min and max of the range are kept
+    auto [min, max] = std::minmax_element(arr.begin() + first, arr.begin() + last, [](auto &l, auto &r) { return l.y() < r.y(); });
+    REQUIRE(std::find(points.begin(), points.end(), *min) != points.end());
+    REQUIRE(std::find(points.begin(), points.end(), *max) != points.end());
+  }
+
+  // updated incrementally, the same as built at once
+  MinMaxPyramid updated;
+  std::vector<QPointF> partial;
+  for (size_t size : {1, 2, 3, 100, 101, 4097, 10000}) {
+    const size_t from = partial.size();
+    partial.insert(partial.end(), arr.begin() + partial.size(), arr.begin() + size);
+    updated.update(partial, from);
+  }
+  arr[5000].setY(1000);
+  updated.update(arr, 5000);
+  pyramid.build(arr);
+  for (int max_points : {16, 100, 1000}) {
+    std::vector<QPointF> expected, points;
+    pyramid.decimate(arr, 0, arr.size(), max_points, expected);
+    updated.decimate(arr, 0, arr.size(), max_points, points);
+    REQUIRE(points == expected);
+    REQUIRE(std::find(points.begin(), points.end(), arr[5000]) != points.end());
+  }
+}
@@ -0,0 +1,159 @@
+#include "tools/cabana/tools/bitcorrelation.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+#include <QThread>
+#include <QtConcurrent>
+
+// BitCounter
+
+void BitCounter::add(const uint8_t *dat, int size) {
+  const int words = (size + 7) / 8;
+  if (words > planes.size()) {
+    planes.resize(words, {});
+  }
+  for (int w = 0; w < words; ++w) {
+    uint64_t x = 0;
+    memcpy(&x, dat + w * 8, std::min(8, size - w * 8));
+    // ripple the carries through the planes, plane p holds bit p of each counter
+    for (auto &plane : planes[w]) {
+      const uint64_t carry = plane & x;
+      plane ^= x;
+      x = carry;
+      if (!x) break;
+    }
+  }
+  if (++pending == (1 << PLANES) - 1) {
+    flush();
+  }
+}
+
+void BitCounter::flush() {
+  if (pending == 0) return;
+
+  counts.resize(std::max(counts.size(), planes.size() * 64));
+  for (int w = 0; w < planes.size(); ++w) {
+    for (int pos = 0; pos < 64; ++pos) {
+      uint32_t n = 0;
+      for (int p = 0; p < PLANES; ++p) {
+        n |= ((planes[w][p] >> pos) & 1) << p;
+      }
+      // words are loaded little endian
+      counts[(w * 8 + pos / 8) * 8 + 7 - pos % 8] += n;
+    }
+    planes[w] = {};
+  }
+  pending = 0;
+}
+
+// BitCorrelation
+
+namespace {
+
+enum TargetState {
+  UNKNOWN = 0,  // before the first target message of the shard
+  ZERO,
+  ONE,
+};
+
+struct Counts {
+  uint32_t count = 0;
+  std::array<uint32_t, CAN_MAX_DATA_BYTES + 1> sizes = {};  // messages by size
+  BitCounter ones;
+};
+
+struct Shard {
+  CanEventIter first, last;
+  std::unordered_map<uint32_t, std::array<Counts, 3>> msgs;  // by address and TargetState
+  TargetState last_state = UNKNOWN;
+};
+
+void processShard(Shard &shard, const BitCorrelation::Target &target, uint8_t find_bus, const std::atomic<bool> &canceled,
+                  std::atomic<size_t> &done, size_t total, const std::function<void(size_t, size_t)> &progress) {
+  const int report_interval = 64 * 1024;
+  TargetState state = UNKNOWN;
+  int n = 0;
+  for (auto it = shard.first; it != shard.last; ++it) {
+    const CanEvent *e = *it;
+    if (e->src == target.bus && e->address == target.address && e->size > target.byte_idx) {
+      state = (e->dat[target.byte_idx] >> (7 - target.bit_idx)) & 1 ? ONE : ZERO;
+    }
+    if (e->src == find_bus) {
+      auto &c = shard.msgs[e->address][state];
+      ++c.count;
+      ++c.sizes[e->size];
+      c.ones.add(e->dat, e->size);
+    }
+
+    if (++n == report_interval) {
+      if (canceled) return;
+      if (progress) progress(done += n, total);
+      n = 0;
+    }
+  }
+  if (progress) progress(done += n, total);
+  shard.last_state = state;
+}
+
+void addCounts(BitCorrelation::MessageStats &stats, Counts &counts, TargetState state) {
+  counts.ones.flush();
+  int max_size = CAN_MAX_DATA_BYTES;
+  while (max_size > 0 && counts.sizes[max_size] == 0) --max_size;
+  if (stats.same.size() < max_size * 8) {
+    stats.same.resize(max_size * 8);
+    stats.differ.resize(max_size * 8);
+  }
+
+  // messages that have the byte of each bit
+  uint32_t with_byte = counts.count;
+  for (int byte = 0; byte < max_size; ++byte) {
+    with_byte -= counts.sizes[byte];
+    for (int bit = 0; bit < 8; ++bit) {
+      const int i = byte * 8 + bit;
+      const uint32_t ones = i < counts.ones.counts.size() ? counts.ones.counts[i] : 0;
+      stats.same[i] += state == ONE ? ones : with_byte - ones;
+      stats.differ[i] += state == ONE ? with_byte - ones : ones;
+    }
+  }
+}
+
+}  // namespace
+
+std::map<uint32_t, BitCorrelation::MessageStats> BitCorrelation::compute(const CanEventList &events, const Target &target,
+                                                                          uint8_t find_bus, const std::atomic<bool> &canceled,
+                                                                          std::function<void(size_t, size_t)> progress) {
+  const size_t num_shards = std::clamp<size_t>(events.size() / (64 * 1024), 1, QThread::idealThreadCount());
+  std::vector<Shard> shards(num_shards);
+  for (size_t i = 0; i < num_shards; ++i) {
+    shards[i].first = events.begin() + events.size() * i / num_shards;
+    shards[i].last = events.begin() + events.size() * (i + 1) / num_shards;
+  }
+
+  std::atomic<size_t> done = 0;
+  QtConcurrent::blockingMap(shards, [&](Shard &shard) {
+    processShard(shard, target, find_bus, canceled, done, events.size(), progress);
+  });
+  if (canceled) return {};
+
+  std::map<uint32_t, MessageStats> result;
+  TargetState state = UNKNOWN;
+  for (auto &shard : shards) {
+    for (auto &[address, counts] : shard.msgs) {
+      auto &stats = result[address];
+      for (int s : {UNKNOWN, ZERO, ONE}) {
+        stats.count += counts[s].count;
+        // messages before the first target message of the shard have the state the previous shards ended with
+        const TargetState resolved = s == UNKNOWN ? state : (TargetState)s;
+        if (resolved != UNKNOWN && counts[s].count > 0) {
+          addCounts(stats, counts[s], resolved);
+        }
+      }
+    }
+    if (shard.last_state != UNKNOWN) {
+      state = shard.last_state;
+    }
+  }
+  return result;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <vector>
+
+#include "tools/cabana/streams/abstractstream.h"
+
+// Counts the set bits of each bit position over many messages. Words are added to bit-sliced
+// counters, so a message costs a few and/xor operations per 64 bits instead of one add per bit.
+class BitCounter {
+public:
+  void add(const uint8_t *dat, int size);
+  // adds the pending words to counts
+  void flush();
+  // by bit index: byte * 8 + bit, bit 0 is the most significant bit of the byte
+  std::vector<uint32_t> counts;
+
+private:
+  static constexpr int PLANES = 8;  // flushed every 255 words
+  std::vector<std::array<uint64_t, PLANES>> planes;
+  int pending = 0;
+};
+
+// Compares a target bit, which holds the value of the latest target message, with every bit of
+// every message on a bus. The events are split into one shard per core, the messages before the
+// first target message of a shard get the target value at the end of the previous shards.
+namespace BitCorrelation {
+
+struct Target {
+  uint8_t bus;
+  uint32_t address;
+  int byte_idx;
+  int bit_idx;  // bit 0 is the most significant bit of the byte
+};
+
+struct MessageStats {
+  uint32_t count = 0;          // all messages
+  std::vector<uint32_t> same;  // by bit index, messages where the bit equals the target bit
+  std::vector<uint32_t> differ;
+};
+
+// by address. progress is called on worker threads, the result is empty if canceled.
+std::map<uint32_t, MessageStats> compute(const CanEventList &events, const Target &target, uint8_t find_bus,
+                                         const std::atomic<bool> &canceled,
+                                         std::function<void(size_t done, size_t total)> progress = nullptr);
+
+}  // namespace BitCorrelation
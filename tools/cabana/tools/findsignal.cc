@@ -4,7 +4,6 @@
 #include <QHBoxLayout>
 #include <QHeaderView>
 #include <QMenu>
-#include <QtConcurrent>
 #include <QTimer>
 #include <QVBoxLayout>
 
@@ -28,34 +27,42 @@ QVariant FindSignalModel::data(const QModelIndex &index, int role) const {
   return {};
 }
 
-void FindSignalModel::search(std::function<bool(double)> cmp) {
+void FindSignalModel::search(const SignalIndex::Query &query) {
   beginResetModel();
 
-  std::mutex lock;
+  updateIndex();
   const auto prev_sigs = !histories.isEmpty() ? histories.back() : initial_signals;
-  filtered_signals.clear();
-  filtered_signals.reserve(prev_sigs.size());
-  QtConcurrent::blockingMap(prev_sigs, [&](auto &s) {
-    const auto &events = can->events(s.id);
-    auto first = std::upper_bound(events.cbegin(), events.cend(), s.mono_time, CompareCanEvent());
-    auto last = events.cend();
-    if (last_time < std::numeric_limits<uint64_t>::max()) {
-      last = std::upper_bound(events.cbegin(), events.cend(), last_time, CompareCanEvent());
-    }
+  std::vector<SignalIndex::Candidate> candidates;
+  candidates.reserve(prev_sigs.size());
+  for (const auto &s : prev_sigs) {
+    candidates.push_back({.id = s.id, .mono_time = s.mono_time, .sig = s.sig});
+  }
+  const auto matches = index.search(candidates, query);
 
-    auto it = std::find_if(first, last, [&](const CanEvent *e) { return cmp(get_raw_value(e->dat, e->size, s.sig)); });
-    if (it != last) {
+  filtered_signals.clear();
+  for (int i = 0; i < prev_sigs.size(); ++i) {
+    if (const auto &m = matches[i]; m.found) {
+      const auto &s = prev_sigs[i];
       auto values = s.values;
-      values += QString("(%1, %2)").arg(can->toSeconds((*it)->mono_time), 0, 'f', 3).arg(get_raw_value((*it)->dat, (*it)->size, s.sig));
-      std::lock_guard lk(lock);
-      filtered_signals.push_back({.id = s.id, .mono_time = (*it)->mono_time, .sig = s.sig, .values = values});
+      values += QString("(%1, %2)").arg(can->toSeconds(m.mono_time), 0, 'f', 3).arg(m.value);
+      filtered_signals.push_back({.id = s.id, .mono_time = m.mono_time, .sig = s.sig, .values = values});
     }
-  });
+  }
   histories.push_back(filtered_signals);
 
   endResetModel();
 }
 
+void FindSignalModel::updateIndex() {
+  // index the events merged since the last search, e.g. from a live stream or a later loaded segment
+  for (const auto &id : message_ids) {
+    const auto &events = can->events(id);
+    auto first = std::lower_bound(events.cbegin(), events.cend(), first_time, CompareCanEvent());
+    auto last = std::upper_bound(first, events.cend(), last_time, CompareCanEvent());
+    index.update(id, first, last);
+  }
+}
+
 void FindSignalModel::undo() {
   if (!histories.isEmpty()) {
     beginResetModel();
@@ -71,6 +78,8 @@ void FindSignalModel::reset() {
   histories.clear();
   filtered_signals.clear();
   initial_signals.clear();
+  message_ids.clear();
+  index.clear();
   endResetModel();
 }
 
@@ -130,7 +139,7 @@ FindSignalDlg::FindSignalDlg(QWidget *parent) : QDialog(parent, Qt::WindowFlags(
   hlayout->addWidget(reset_btn = new QPushButton(tr("Reset"), this));
   vlayout->addLayout(hlayout);
 
-  compare_cb->addItems({"=", ">", ">=", "!=", "<", "<=", "between"});
+  compare_cb->addItems({"=", ">", ">=", "!=", "<", "<=", "between", "changed"});
   value1->setFocus(Qt::OtherFocusReason);
   value2->setVisible(false);
   to_label->setVisible(false);
@@ -166,8 +175,9 @@ FindSignalDlg::FindSignalDlg(QWidget *parent) : QDialog(parent, Qt::WindowFlags(
     if (index.isValid()) emit openMessage(model->filtered_signals[index.row()].id);
   });
   QObject::connect(compare_cb, qOverload<int>(&QComboBox::currentIndexChanged), [=](int index) {
-    to_label->setVisible(index == compare_cb->count() - 1);
-    value2->setVisible(index == compare_cb->count() - 1);
+    value1->setVisible(index != SignalIndex::CHANGED);
+    to_label->setVisible(index == SignalIndex::BETWEEN);
+    value2->setVisible(index == SignalIndex::BETWEEN);
   });
 }
 
@@ -175,24 +185,16 @@ void FindSignalDlg::search() {
   if (model->histories.isEmpty()) {
     setInitialSignals();
   }
-  auto v1 = value1->text().toDouble();
-  auto v2 = value2->text().toDouble();
-  std::function<bool(double)> cmp = nullptr;
-  switch (compare_cb->currentIndex()) {
-    case 0: cmp = [v1](double v) { return v == v1;}; break;
-    case 1: cmp = [v1](double v) { return v > v1;}; break;
-    case 2: cmp = [v1](double v) { return v >= v1;}; break;
-    case 3: cmp = [v1](double v) { return v != v1;}; break;
-    case 4: cmp = [v1](double v) { return v < v1;}; break;
-    case 5: cmp = [v1](double v) { return v <= v1;}; break;
-    case 6: cmp = [v1, v2](double v) { return v >= v1 && v <= v2;}; break;
-  }
+  // the items of compare_cb are in the order of SignalIndex::Compare
+  SignalIndex::Query query{.op = (SignalIndex::Compare)compare_cb->currentIndex(),
+                           .v1 = value1->text().toDouble(),
+                           .v2 = value2->text().toDouble()};
   properties_group->setEnabled(false);
   message_group->setEnabled(false);
   search_btn->setEnabled(false);
   stats_label->setVisible(false);
   search_btn->setText("Finding ....");
-  QTimer::singleShot(0, this, [=]() { model->search(cmp); });
+  QTimer::singleShot(0, this, [=]() { model->search(query); });
 }
 
 void FindSignalDlg::setInitialSignals() {
@@ -217,22 +219,25 @@ void FindSignalDlg::setInitialSignals() {
   double first_time_val = first_time_edit->text().toDouble();
   double last_time_val = last_time_edit->text().toDouble();
   auto [first_sec, last_sec] = std::minmax(first_time_val, last_time_val);
-  uint64_t first_time = can->toMonoTime(first_sec);
+  model->first_time = can->toMonoTime(first_sec);
   model->last_time = std::numeric_limits<uint64_t>::max();
   if (last_sec > 0) {
     model->last_time = can->toMonoTime(last_sec);
   }
   model->initial_signals.clear();
+  model->message_ids.clear();
+  model->index.clear();
 
   for (const auto &[id, m] : can->lastMessages()) {
     if ((buses.isEmpty() || buses.contains(id.source)) && (addresses.isEmpty() || addresses.contains(id.address))) {
       const auto &events = can->events(id);
-      auto e = std::lower_bound(events.cbegin(), events.cend(), first_time, CompareCanEvent());
+      auto e = std::lower_bound(events.cbegin(), events.cend(), model->first_time, CompareCanEvent());
       if (e != events.cend()) {
+        model->message_ids.push_back(id);
         const int total_size = m.dat.size() * 8;
         for (int size = min_size->value(); size <= max_size->value(); ++size) {
           for (int start = 0; start <= total_size - size; ++start) {
-            FindSignalModel::SearchSignal s{.id = id, .mono_time = first_time, .sig = sig};
+            FindSignalModel::SearchSignal s{.id = id, .mono_time = model->first_time, .sig = sig};
             s.sig.start_bit = start;
             s.sig.size = size;
             updateMsbLsb(s.sig);
@@ -11,6 +11,7 @@
 
 #include "tools/cabana/commands.h"
 #include "tools/cabana/settings.h"
+#include "tools/cabana/tools/signalindex.h"
 
 class FindSignalModel : public QAbstractTableModel {
 public:
@@ -27,14 +28,20 @@ public:
   QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
   int columnCount(const QModelIndex &parent = QModelIndex()) const override { return 3; }
   int rowCount(const QModelIndex &parent = QModelIndex()) const override { return std::min(filtered_signals.size(), 300); }
-  void search(std::function<bool(double)> cmp);
+  void search(const SignalIndex::Query &query);
   void reset();
   void undo();
 
   QList<SearchSignal> filtered_signals;
   QList<SearchSignal> initial_signals;
   QList<QList<SearchSignal>> histories;
+  std::vector<MessageId> message_ids;
+  SignalIndex index;
+  uint64_t first_time = 0;
   uint64_t last_time = std::numeric_limits<uint64_t>::max();
+
+private:
+  void updateIndex();
 };
 
 class FindSignalDlg : public QDialog {
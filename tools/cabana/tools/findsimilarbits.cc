@@ -9,6 +9,7 @@
 #include <QLabel>
 #include <QPushButton>
 #include <QRadioButton>
+#include <QtConcurrent>
 
 #include "tools/cabana/dbc/dbcmanager.h"
 #include "tools/cabana/streams/abstractstream.h"
@@ -76,6 +77,10 @@ FindSimilarBitsDlg::FindSimilarBitsDlg(QWidget *parent) : QDialog(parent, Qt::Wi
   grid_layout->addLayout(find_layout, 1, 1);
   main_layout->addLayout(grid_layout);
 
+  progress_bar = new QProgressBar(this);
+  progress_bar->setVisible(false);
+  main_layout->addWidget(progress_bar);
+
   table = new QTableWidget(this);
   table->setSelectionBehavior(QAbstractItemView::SelectRows);
   table->setSelectionMode(QAbstractItemView::SingleSelection);
@@ -85,6 +90,7 @@ FindSimilarBitsDlg::FindSimilarBitsDlg(QWidget *parent) : QDialog(parent, Qt::Wi
 
   setMinimumSize({700, 500});
   QObject::connect(search_btn, &QPushButton::clicked, this, &FindSimilarBitsDlg::find);
+  QObject::connect(&watcher, &QFutureWatcher<void>::finished, this, &FindSimilarBitsDlg::searchFinished);
   QObject::connect(table, &QTableWidget::doubleClicked, [this](const QModelIndex &index) {
     if (index.isValid()) {
       MessageId msg_id = {.source = (uint8_t)find_bus_combo->currentData().toUInt(), .address = table->item(index.row(), 0)->text().toUInt(0, 16)};
@@ -93,12 +99,71 @@ FindSimilarBitsDlg::FindSimilarBitsDlg(QWidget *parent) : QDialog(parent, Qt::Wi
   });
 }
 
+FindSimilarBitsDlg::~FindSimilarBitsDlg() {
+  stopSearch();
+  if (searching) can->holdEvents(false);
+}
+
 void FindSimilarBitsDlg::find() {
-  search_btn->setEnabled(false);
+  if (watcher.isRunning()) {
+    stopSearch();
+    return;
+  }
+
   table->clear();
-  uint32_t selected_address = msg_cb->currentData().toUInt();
-  auto msg_mismatched = calcBits(src_bus_combo->currentText().toUInt(), selected_address, byte_idx_sb->value(), bit_idx_sb->value(),
-                                 find_bus_combo->currentText().toUInt(), equal_combo->currentIndex() == 0, min_msgs->text().toInt());
+  table->setRowCount(0);
+  search_btn->setText(tr("&Cancel"));
+  progress_bar->setValue(0);
+  progress_bar->setVisible(true);
+
+  events = can->allEvents();
+  can->holdEvents(true);
+  searching = true;
+  canceled = false;
+  BitCorrelation::Target target = {
+    .bus = (uint8_t)src_bus_combo->currentText().toUInt(),
+    .address = msg_cb->currentData().toUInt(),
+    .byte_idx = byte_idx_sb->value(),
+    .bit_idx = bit_idx_sb->value(),
+  };
+  const uint8_t find_bus = find_bus_combo->currentText().toUInt();
+  watcher.setFuture(QtConcurrent::run([this, target, find_bus]() {
+    return BitCorrelation::compute(events, target, find_bus, canceled, [this](size_t done, size_t total) {
+      QMetaObject::invokeMethod(progress_bar, "setValue", Qt::QueuedConnection, Q_ARG(int, done * 100 / std::max<size_t>(total, 1)));
+    });
+  }));
+}
+
+void FindSimilarBitsDlg::stopSearch() {
+  if (watcher.isRunning()) {
+    canceled = true;
+    watcher.waitForFinished();
+  }
+}
+
+void FindSimilarBitsDlg::searchFinished() {
+  can->holdEvents(false);
+  searching = false;
+  events = {};
+  search_btn->setText(tr("&Find"));
+  progress_bar->setVisible(false);
+  if (canceled) return;
+
+  const bool equal = equal_combo->currentIndex() == 0;
+  const int min_msgs_cnt = min_msgs->text().toInt();
+  QList<mismatched_struct> msg_mismatched;
+  for (const auto &[address, stats] : watcher.result()) {
+    if (stats.count > min_msgs_cnt) {
+      const auto &mismatched = equal ? stats.differ : stats.same;
+      for (int i = 0; i < mismatched.size(); ++i) {
+        if (float perc = (mismatched[i] / (double)stats.count) * 100; perc < 50) {
+          msg_mismatched.push_back({address, (uint32_t)i / 8, (uint32_t)i % 8, mismatched[i], stats.count, perc});
+        }
+      }
+    }
+  }
+  std::sort(msg_mismatched.begin(), msg_mismatched.end(), [](auto &l, auto &r) { return l.perc < r.perc; });
+
   table->setRowCount(msg_mismatched.size());
   table->setColumnCount(6);
   table->setHorizontalHeaderLabels({"address", "byte idx", "bit idx", "mismatches", "total msgs", "% mismatched"});
@@ -111,50 +176,4 @@ void FindSimilarBitsDlg::find() {
     table->setItem(i, 4, new QTableWidgetItem(QString::number(m.total)));
     table->setItem(i, 5, new QTableWidgetItem(QString::number(m.perc, 'f', 2)));
   }
-  search_btn->setEnabled(true);
-}
-
-QList<FindSimilarBitsDlg::mismatched_struct> FindSimilarBitsDlg::calcBits(uint8_t bus, uint32_t selected_address, int byte_idx,
-                                                                          int bit_idx, uint8_t find_bus, bool equal, int min_msgs_cnt) {
-  QHash<uint32_t, QVector<uint32_t>> mismatches;
-  QHash<uint32_t, uint32_t> msg_count;
-  const auto &events = can->allEvents();
-  int bit_to_find = -1;
-  for (const CanEvent *e : events) {
-    if (e->src == bus) {
-      if (e->address == selected_address && e->size > byte_idx) {
-        bit_to_find = ((e->dat[byte_idx] >> (7 - bit_idx)) & 1) != 0;
-      }
-    }
-    if (e->src == find_bus) {
-      ++msg_count[e->address];
-      if (bit_to_find == -1) continue;
-
-      auto &mismatched = mismatches[e->address];
-      if (mismatched.size() < e->size * 8) {
-        mismatched.resize(e->size * 8);
-      }
-      for (int i = 0; i < e->size; ++i) {
-        for (int j = 0; j < 8; ++j) {
-          int bit = ((e->dat[i] >> (7 - j)) & 1) != 0;
-          mismatched[i * 8 + j] += equal ? (bit != bit_to_find) : (bit == bit_to_find);
-        }
-      }
-    }
-  }
-
-  QList<mismatched_struct> result;
-  result.reserve(mismatches.size());
-  for (auto it = mismatches.begin(); it != mismatches.end(); ++it) {
-    if (auto cnt = msg_count[it.key()]; cnt > min_msgs_cnt) {
-      auto &mismatched = it.value();
-      for (int i = 0; i < mismatched.size(); ++i) {
-        if (float perc = (mismatched[i] / (double)cnt) * 100; perc < 50) {
-          result.push_back({it.key(), (uint32_t)i / 8, (uint32_t)i % 8, mismatched[i], cnt, perc});
-        }
-      }
-    }
-  }
-  std::sort(result.begin(), result.end(), [](auto &l, auto &r) { return l.perc < r.perc; });
-  return result;
 }
@@ -1,18 +1,25 @@
 #pragma once
 
+#include <atomic>
+#include <map>
+
 #include <QComboBox>
 #include <QDialog>
+#include <QFutureWatcher>
 #include <QLineEdit>
+#include <QProgressBar>
 #include <QSpinBox>
 #include <QTableWidget>
 
 #include "tools/cabana/dbc/dbcmanager.h"
+#include "tools/cabana/tools/bitcorrelation.h"
 
 class FindSimilarBitsDlg : public QDialog {
   Q_OBJECT
 
 public:
   FindSimilarBitsDlg(QWidget *parent);
+  ~FindSimilarBitsDlg();
 
 signals:
   void openMessage(const MessageId &msg_id);
@@ -22,13 +29,20 @@ private:
     uint32_t address, byte_idx, bit_idx, mismatches, total;
     float perc;
   };
-  QList<mismatched_struct> calcBits(uint8_t bus, uint32_t selected_address, int byte_idx, int bit_idx, uint8_t find_bus,
-                                    bool equal, int min_msgs_cnt);
   void find();
+  void searchFinished();
+  void stopSearch();
 
   QTableWidget *table;
   QComboBox *src_bus_combo, *find_bus_combo, *msg_cb, *equal_combo;
   QSpinBox *byte_idx_sb, *bit_idx_sb;
   QPushButton *search_btn;
   QLineEdit *min_msgs;
+  QProgressBar *progress_bar;
+
+  // the search runs on a copy of the event list, which is held until it finishes
+  CanEventList events;
+  bool searching = false;
+  std::atomic<bool> canceled = false;
+  QFutureWatcher<std::map<uint32_t, BitCorrelation::MessageStats>> watcher;
 };
@@ -0,0 +1,205 @@
+#include "tools/cabana/tools/signalindex.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#include <QtConcurrent>
+
+namespace {
+
+// compares 64 values at a time into a bit mask, which the compiler can vectorize
+template <class Cmp>
+size_t findFirst(const double *values, size_t n, Cmp cmp) {
+  for (size_t i = 0; i < n; i += 64) {
+    const size_t len = std::min<size_t>(64, n - i);
+    uint64_t mask = 0;
+    for (size_t j = 0; j < len; ++j) {
+      mask |= (uint64_t)cmp(values[i + j]) << j;
+    }
+    if (mask) return i + __builtin_ctzll(mask);
+  }
+  return n;
+}
+
+size_t findFirst(const double *values, size_t n, const SignalIndex::Query &q, double ref) {
+  const double v1 = q.v1, v2 = q.v2;
+  switch (q.op) {
+    case SignalIndex::EQUAL: return findFirst(values, n, [=](double v) { return v == v1; });
+    case SignalIndex::GREATER: return findFirst(values, n, [=](double v) { return v > v1; });
+    case SignalIndex::GREATER_EQUAL: return findFirst(values, n, [=](double v) { return v >= v1; });
+    case SignalIndex::NOT_EQUAL: return findFirst(values, n, [=](double v) { return v != v1; });
+    case SignalIndex::LESS: return findFirst(values, n, [=](double v) { return v < v1; });
+    case SignalIndex::LESS_EQUAL: return findFirst(values, n, [=](double v) { return v <= v1; });
+    case SignalIndex::BETWEEN: return findFirst(values, n, [=](double v) { return v >= v1 && v <= v2; });
+    case SignalIndex::CHANGED: return findFirst(values, n, [=](double v) { return v != ref; });
+  }
+  return n;
+}
+
+}  // namespace
+
+void SignalIndex::append(const MessageId &id, CanEventIter first, CanEventIter last) {
+  if (first == last) return;
+
+  auto &m = messages_[id];
+  int max_size = 0;
+  for (auto it = first; it != last; ++it) {
+    max_size = std::max<int>(max_size, (*it)->size);
+  }
+  const size_t n = m.mono_times.size();
+  const size_t total = n + (last - first);
+  const size_t num_words = std::max((max_size + 7) / 8 + 1, (int)m.words.size());
+  m.words.resize(num_words);
+  for (auto &column : m.words) {
+    column.resize(total, 0);
+  }
+  m.mono_times.resize(total);
+  m.sizes.resize(total);
+
+  size_t i = n;
+  for (auto it = first; it != last; ++it, ++i) {
+    const CanEvent *e = *it;
+    m.mono_times[i] = e->mono_time;
+    m.sizes[i] = e->size;
+    m.min_size = std::min(m.min_size, e->size);
+    for (int w = 0; w * 8 < e->size; ++w) {
+      memcpy(&m.words[w][i], e->dat + w * 8, std::min(8, e->size - w * 8));
+    }
+  }
+}
+
+void SignalIndex::update(const MessageId &id, CanEventIter first, CanEventIter last) {
+  auto it = messages_.find(id);
+  if (it == messages_.end() || it->second.mono_times.empty()) {
+    append(id, first, last);
+    return;
+  }
+
+  const auto &mono_times = it->second.mono_times;
+  auto indexed_last = std::upper_bound(first, last, mono_times.back(), CompareCanEvent());
+  if ((size_t)(indexed_last - first) != mono_times.size() || (first != last && (*first)->mono_time != mono_times.front())) {
+    messages_.erase(it);
+    indexed_last = first;
+  }
+  append(id, indexed_last, last);
+}
+
+uint64_t SignalIndex::lastTime(const MessageId &id) const {
+  auto it = messages_.find(id);
+  return it != messages_.end() && !it->second.mono_times.empty() ? it->second.mono_times.back() : 0;
+}
+
+// same values as SignalDecoder::value() of the events [first, last)
+void SignalIndex::decode(const Message &m, const cabana::SignalDecoder &decoder, size_t first, size_t last, double *values) const {
+  const auto &p = decoder.valuePlan();
+  const size_t n = last - first;
+  if (!p.fast) {
+    // signals spanning more than 8 bytes
+    uint8_t dat[(CAN_MAX_DATA_BYTES / 8 + 1) * 8];
+    for (size_t i = 0; i < n; ++i) {
+      for (size_t w = 0; w < m.words.size(); ++w) {
+        memcpy(dat + w * 8, &m.words[w][first + i], 8);
+      }
+      values[i] = decoder.value(dat, m.sizes[first + i]);
+    }
+    return;
+  }
+  if (p.load_byte / 8 + 1 >= m.words.size()) {
+    // beyond the payload of all events
+    std::fill_n(values, n, (int64_t)0 * p.factor + p.offset);
+    return;
+  }
+
+  // the 8 bytes at load_byte are the upper bytes of one word and the lower bytes of the next
+  const uint64_t *lo = m.words[p.load_byte / 8].data() + first;
+  const uint64_t *hi = m.words[p.load_byte / 8 + 1].data() + first;
+  const uint8_t *sizes = m.sizes.data() + first;
+  const int byte_shift = (p.load_byte % 8) * 8;
+  const bool check_size = p.msb_byte >= m.min_size;
+  const bool big_endian = p.big_endian, is_signed = p.is_signed;
+  const int shift = p.shift, sign_shift = p.sign_shift;
+  const uint64_t mask = p.mask;
+  const uint64_t msb_byte = p.msb_byte;
+  const double factor = p.factor, offset = p.offset;
+  for (size_t i = 0; i < n; ++i) {
+    // (hi << 1) << 63 is 0 for aligned loads
+    uint64_t d = (lo[i] >> byte_shift) | ((hi[i] << 1) << (63 - byte_shift));
+    if (big_endian) d = __builtin_bswap64(d);
+    uint64_t raw = (d >> shift) & mask;
+    if (check_size && sizes[i] <= msb_byte) raw = 0;
+    const int64_t val = is_signed ? (int64_t)(raw << sign_shift) >> sign_shift : (int64_t)raw;
+    values[i] = val * factor + offset;
+  }
+}
+
+std::vector<SignalIndex::Match> SignalIndex::search(const std::vector<Candidate> &candidates, const Query &query) const {
+  struct Task {
+    const Message *msg;
+    const std::vector<int> *candidates;
+    size_t first, last;
+  };
+
+  const size_t num = candidates.size();
+  std::vector<cabana::SignalDecoder> decoders;
+  decoders.reserve(num);
+  std::vector<const Message *> msgs(num, nullptr);
+  std::vector<size_t> starts(num, 0);
+  std::vector<double> refs(num, 0);
+  std::unordered_map<const Message *, std::vector<int>> groups;
+  for (int i = 0; i < num; ++i) {
+    const auto &c = candidates[i];
+    const auto &decoder = decoders.emplace_back(c.sig);
+    auto it = messages_.find(c.id);
+    if (it == messages_.end() || it->second.mono_times.empty()) continue;
+
+    const Message &m = it->second;
+    msgs[i] = &m;
+    starts[i] = std::upper_bound(m.mono_times.begin(), m.mono_times.end(), c.mono_time) - m.mono_times.begin();
+    if (query.op == CHANGED) {
+      // compare with the value at mono_time, or with the first value
+      const size_t ref = starts[i] > 0 ? starts[i] - 1 : 0;
+      decode(m, decoder, ref, ref + 1, &refs[i]);
+      starts[i] = std::max<size_t>(starts[i], 1);
+    }
+    groups[&m].push_back(i);
+  }
+
+  // one task per block of each message, every task scans all candidates of its message
+  std::vector<Task> tasks;
+  for (const auto &[m, group] : groups) {
+    size_t first = m->mono_times.size();
+    for (int i : group) first = std::min(first, starts[i]);
+    for (size_t b = first; b < m->mono_times.size(); b += BLOCK_SIZE) {
+      tasks.push_back({m, &group, b, std::min(b + BLOCK_SIZE, m->mono_times.size())});
+    }
+  }
+
+  std::vector<std::atomic<size_t>> found(num);
+  for (auto &f : found) f = SIZE_MAX;
+  QtConcurrent::blockingMap(tasks, [&](const Task &task) {
+    std::vector<double> values(task.last - task.first);
+    for (int i : *task.candidates) {
+      const size_t first = std::max(task.first, starts[i]);
+      // skip if an earlier block matched
+      if (first >= task.last || found[i] < task.first) continue;
+
+      decode(*task.msg, decoders[i], first, task.last, values.data());
+      const size_t n = findFirst(values.data(), task.last - first, query, refs[i]);
+      if (n < task.last - first) {
+        size_t prev = found[i];
+        while (first + n < prev && !found[i].compare_exchange_weak(prev, first + n)) {}
+      }
+    }
+  });
+
+  std::vector<Match> matches(num);
+  for (int i = 0; i < num; ++i) {
+    if (found[i] != SIZE_MAX) {
+      matches[i].found = true;
+      matches[i].mono_time = msgs[i]->mono_times[found[i]];
+      decode(*msgs[i], decoders[i], found[i], found[i] + 1, &matches[i].value);
+    }
+  }
+  return matches;
+}
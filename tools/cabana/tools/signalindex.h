@@ -0,0 +1,54 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "tools/cabana/dbc/dbc.h"
+#include "tools/cabana/streams/abstractstream.h"
+
+// Packs the payloads of the searched messages into columns of 64-bit words, word w of event i is
+// words[w][i]. A candidate signal decodes with a few shifts and masks per event, and all candidates
+// of a message are scanned over the same cache-sized block of columns before moving to the next.
+class SignalIndex {
+public:
+  enum Compare { EQUAL, GREATER, GREATER_EQUAL, NOT_EQUAL, LESS, LESS_EQUAL, BETWEEN, CHANGED };
+  struct Query {
+    Compare op = EQUAL;
+    double v1 = 0, v2 = 0;
+  };
+  struct Candidate {
+    MessageId id;
+    uint64_t mono_time;  // the events after mono_time are searched
+    cabana::Signal sig;
+  };
+  struct Match {
+    bool found = false;
+    uint64_t mono_time = 0;
+    double value = 0;
+  };
+
+  // events must be sorted and after the indexed events of id
+  void append(const MessageId &id, CanEventIter first, CanEventIter last);
+  // indexes the events of id in [first, last) that are not indexed yet. the index of id is rebuilt
+  // if events were merged before its last indexed event, e.g. an earlier segment.
+  void update(const MessageId &id, CanEventIter first, CanEventIter last);
+  // mono time of the last indexed event of id, 0 if none
+  uint64_t lastTime(const MessageId &id) const;
+  // finds the first event of each candidate that matches query. CHANGED matches values that
+  // differ from the value at the candidate's mono_time.
+  std::vector<Match> search(const std::vector<Candidate> &candidates, const Query &query) const;
+  void clear() { messages_.clear(); }
+
+  static constexpr int BLOCK_SIZE = 4096;  // events, 32KB per word column
+
+private:
+  struct Message {
+    std::vector<uint64_t> mono_times;
+    std::vector<uint8_t> sizes;
+    std::vector<std::vector<uint64_t>> words;  // one zero column more than the largest payload needs
+    uint8_t min_size = CAN_MAX_DATA_BYTES;
+  };
+  void decode(const Message &m, const cabana::SignalDecoder &decoder, size_t first, size_t last, double *values) const;
+
+  std::unordered_map<MessageId, Message> messages_;
+};
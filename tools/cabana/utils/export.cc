@@ -1,5 +1,9 @@
 #include "tools/cabana/utils/export.h"
 
+#include <cmath>
+#include <memory>
+#include <vector>
+
 #include <QFile>
 #include <QTextStream>
 
@@ -29,13 +33,20 @@ void exportSignalsToCSV(const QString &file_name, const MessageId &msg_id) {
       stream << "," << s->name;
     stream << "\n";
 
-    for (auto e : can->events(msg_id)) {
+    const auto &events = can->events(msg_id);
+    std::vector<std::shared_ptr<const SignalSeries>> values;
+    for (auto s : msg->sigs) {
+      values.push_back(can->signalSeries(msg_id, s));
+    }
+
+    size_t i = 0;
+    for (auto it = events.begin(); it != events.end(); ++it, ++i) {
+      const CanEvent *e = *it;
       stream << QString::number(can->toSeconds(e->mono_time), 'f', 3) << ","
              << "0x" << QString::number(e->address, 16) << "," << e->src;
-      for (auto s : msg->sigs) {
-        double value = 0;
-        s->getValue(e->dat, e->size, &value);
-        stream << "," << QString::number(value, 'f', s->precision);
+      for (int j = 0; j < msg->sigs.size(); ++j) {
+        const double value = std::isnan(values[j]->value(i)) ? 0 : values[j]->value(i);
+        stream << "," << QString::number(value, 'f', msg->sigs[j]->precision);
       }
       stream << "\n";
     }
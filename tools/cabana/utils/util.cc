@@ -49,6 +49,84 @@ std::pair<double, double> SegmentTree::get_minmax(int n, int left, int right, in
   return {std::min(l.first, r.first), std::max(l.second, r.second)};
 }
 
+// MinMaxPyramid
+
+void MinMaxPyramid::update(const std::vector<QPointF> &arr, size_t from) {
+  if (arr.size() < 2) {
+    levels.clear();
+    return;
+  }
+  // only the buckets from the one holding arr[from] change, e.g. the last ones when points are appended.
+  // the buckets a level didn't have yet are new as well.
+  if (levels.empty()) levels.emplace_back();
+  auto &buckets = levels[0];
+  const size_t first_bucket = std::min(from / 2, buckets.size());
+  buckets.resize((arr.size() + 1) / 2);
+  for (uint32_t i = first_bucket; i < buckets.size(); ++i) {
+    uint32_t a = 2 * i, b = std::min<uint32_t>(2 * i + 1, arr.size() - 1);
+    buckets[i] = arr[a].y() <= arr[b].y() ? std::pair{a, b} : std::pair{b, a};
+  }
+  size_t level = 0;
+  for (; levels[level].size() > 1; ++level) {
+    if (level + 1 == levels.size()) levels.emplace_back();
+    const auto &prev = levels[level];
+    auto &next = levels[level + 1];
+    const size_t first_bucket = std::min(from >> (level + 2), next.size());
+    next.resize((prev.size() + 1) / 2);
+    for (size_t i = first_bucket; i < next.size(); ++i) {
+      const auto &l = prev[2 * i], &r = prev[std::min(2 * i + 1, prev.size() - 1)];
+      next[i] = {arr[l.first].y() <= arr[r.first].y() ? l.first : r.first,
+                 arr[l.second].y() >= arr[r.second].y() ? l.second : r.second};
+    }
+  }
+  levels.resize(level + 1);
+}
+
+void MinMaxPyramid::decimate(const std::vector<QPointF> &arr, int first, int last, int max_points, std::vector<QPointF> &out) const {
+  if (last - first <= max_points || levels.empty()) {
+    out.insert(out.end(), arr.begin() + first, arr.begin() + last);
+    return;
+  }
+
+  // the smallest buckets that keep at most max_points
+  int level = 0;
+  while (level + 1 < levels.size() && (last - first) >> (level + 1) > max_points / 2) {
+    ++level;
+  }
+  const int shift = level + 1, bucket_size = 1 << shift;
+  auto push = [&](uint32_t min_idx, uint32_t max_idx) {
+    if (min_idx > max_idx) std::swap(min_idx, max_idx);
+    out.push_back(arr[min_idx]);
+    if (max_idx != min_idx) out.push_back(arr[max_idx]);
+  };
+  // the partial buckets at the edges are scanned, so no points outside of the range are added
+  auto scan = [&](int begin, int end) {
+    uint32_t min_idx = begin, max_idx = begin;
+    for (int i = begin + 1; i < end; ++i) {
+      if (arr[i].y() < arr[min_idx].y()) min_idx = i;
+      if (arr[i].y() > arr[max_idx].y()) max_idx = i;
+    }
+    push(min_idx, max_idx);
+  };
+
+  const size_t out_first = out.size();
+  int i = first;
+  if (int head_end = std::min(last, (first + bucket_size - 1) & ~(bucket_size - 1)); i < head_end) {
+    scan(i, head_end);
+    i = head_end;
+  }
+  for (; i + bucket_size <= last; i += bucket_size) {
+    push(levels[level][i >> shift].first, levels[level][i >> shift].second);
+  }
+  if (i < last) {
+    scan(i, last);
+  }
+
+  // keep the end points, so the lines reach the edges of the range
+  if (out[out_first].x() != arr[first].x()) out.insert(out.begin() + out_first, arr[first]);
+  if (out.back().x() != arr[last - 1].x()) out.push_back(arr[last - 1]);
+}
+
 // MessageBytesDelegate
 
 MessageBytesDelegate::MessageBytesDelegate(QObject *parent, bool multiple_lines)
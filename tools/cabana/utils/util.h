@@ -65,6 +65,20 @@ private:
   int size = 0;
 };
 
+// Indices of the min and max point of consecutive buckets of 2, 4, 8, ... points,
+// so long series can be drawn with a few points per pixel at any zoom level
+class MinMaxPyramid {
+public:
+  void build(const std::vector<QPointF> &arr) { update(arr, 0); }
+  // updates the buckets of arr[from, end), the points before from are the same as in the last update
+  void update(const std::vector<QPointF> &arr, size_t from);
+  // appends arr[first, last) to out, reduced to the min and max points of each bucket if there are more than max_points
+  void decimate(const std::vector<QPointF> &arr, int first, int last, int max_points, std::vector<QPointF> &out) const;
+
+private:
+  std::vector<std::vector<std::pair<uint32_t, uint32_t>>> levels;
+};
+
 class MessageBytesDelegate : public QStyledItemDelegate {
   Q_OBJECT
 public:
@@ -9,6 +9,7 @@
 #include "tools/replay/util.h"
 
 const int BUFFER_COUNT = 40;
+const int PREFETCH_FRAMES = 8;  // decoded ahead of the last sent frame, must be well below BUFFER_COUNT
 
 std::tuple<size_t, size_t, size_t> get_nv12_info(int width, int height) {
   int nv12_width = VENUS_Y_STRIDE(COLOR_FMT_NV12, width);
@@ -30,7 +31,7 @@ CameraServer::~CameraServer() {
   for (auto &cam : cameras_) {
     if (cam.thread.joinable()) {
       // Clear the queue
-      std::pair<FrameReader*, const Event *> item;
+      std::pair<std::shared_ptr<FrameReader>, const Event *> item;
       while (cam.queue.try_pop(item)) {
         --publishing_;
       }
@@ -44,9 +45,15 @@ CameraServer::~CameraServer() {
 }
 
 void CameraServer::startVipcServer() {
+  // camera threads may be decoding ahead into the current buffers
+  std::unique_lock<std::mutex> locks[MAX_CAMERAS];
+  for (int i = 0; i < MAX_CAMERAS; ++i) {
+    locks[i] = std::unique_lock(cameras_[i].lock);
+  }
+
   vipc_server_.reset(new VisionIpcServer("camerad"));
   for (auto &cam : cameras_) {
-    cam.cached_buf.clear();
+    cam.cached_frames.assign(BUFFER_COUNT, {});
 
     if (cam.width > 0 && cam.height > 0) {
       rInfo("camera[%d] frame size %dx%d", cam.type, cam.width, cam.height);
@@ -62,8 +69,23 @@ void CameraServer::startVipcServer() {
 }
 
 void CameraServer::cameraThread(Camera &cam) {
+  std::shared_ptr<FrameReader> prefetch_fr;
+  int prefetch_segment = -1, prefetch_idx = 0, prefetch_end = 0;
+
   while (true) {
-    const auto [fr, event] = cam.queue.pop();
+    std::pair<std::shared_ptr<FrameReader>, const Event *> item;
+    if (!cam.queue.try_pop(item)) {
+      // decode ahead while there are no frames to send
+      if (prefetch_idx < prefetch_end) {
+        std::lock_guard lk(cam.lock);
+        getFrame(cam, prefetch_fr.get(), prefetch_segment, prefetch_idx++);
+        continue;
+      }
+      prefetch_fr.reset();
+      item = cam.queue.pop();
+    }
+
+    const auto &[fr, event] = item;
     if (!fr) break;
 
     capnp::FlatArrayMessageReader reader(event->data);
@@ -72,40 +94,52 @@ void CameraServer::cameraThread(Camera &cam) {
 
     int segment_id = eidx.getSegmentId();
     uint32_t frame_id = eidx.getFrameId();
-    if (auto yuv = getFrame(cam, fr, segment_id, frame_id)) {
-      VisionIpcBufExtra extra = {
-          .frame_id = frame_id,
-          .timestamp_sof = eidx.getTimestampSof(),
-          .timestamp_eof = eidx.getTimestampEof(),
-      };
-      vipc_server_->send(yuv, &extra);
-    } else {
-      rError("camera[%d] failed to get frame: %lu", cam.type, segment_id);
+    {
+      std::lock_guard lk(cam.lock);
+      if (auto yuv = getFrame(cam, fr.get(), event->eidx_segnum, segment_id)) {
+        yuv->set_frame_id(frame_id);
+        VisionIpcBufExtra extra = {
+            .frame_id = frame_id,
+            .timestamp_sof = eidx.getTimestampSof(),
+            .timestamp_eof = eidx.getTimestampEof(),
+        };
+        vipc_server_->send(yuv, &extra);
+      } else {
+        rError("camera[%d] failed to get frame: %lu", cam.type, segment_id);
+      }
     }
 
-    // Prefetch the next frame
-    getFrame(cam, fr, segment_id + 1, frame_id + 1);
+    prefetch_fr = fr;
+    prefetch_segment = event->eidx_segnum;
+    prefetch_idx = segment_id + 1;
+    prefetch_end = std::min<int>(prefetch_idx + PREFETCH_FRAMES, fr->getFrameCount());
 
     --publishing_;
   }
 }
 
-VisionBuf *CameraServer::getFrame(Camera &cam, FrameReader *fr, int32_t segment_id, uint32_t frame_id) {
+VisionBuf *CameraServer::getFrame(Camera &cam, FrameReader *fr, int segment, int frame_idx) {
+  auto &frames = cam.cached_frames;
   // Check if the frame is cached
-  auto buf_it = std::find_if(cam.cached_buf.begin(), cam.cached_buf.end(),
-                             [frame_id](VisionBuf *buf) { return buf->get_frame_id() == frame_id; });
-  if (buf_it != cam.cached_buf.end()) return *buf_it;
-
-  VisionBuf *yuv_buf = vipc_server_->get_buffer(cam.stream_type);
-  if (fr->get(segment_id, yuv_buf)) {
-    yuv_buf->set_frame_id(frame_id);
-    cam.cached_buf.insert(yuv_buf);
+  auto it = std::find_if(frames.begin(), frames.end(),
+                         [=](auto &f) { return f.segment == segment && f.frame_idx == frame_idx; });
+  if (it != frames.end()) {
+    it->last_used = ++cam.use_count;
+    return vipc_server_->get_buffer(cam.stream_type, it - frames.begin());
+  }
+
+  // Decode into the least recently used buffer
+  it = std::min_element(frames.begin(), frames.end(), [](auto &a, auto &b) { return a.last_used < b.last_used; });
+  VisionBuf *yuv_buf = vipc_server_->get_buffer(cam.stream_type, it - frames.begin());
+  *it = {};
+  if (fr->get(frame_idx, yuv_buf)) {
+    *it = {.segment = segment, .frame_idx = frame_idx, .last_used = ++cam.use_count};
     return yuv_buf;
   }
   return nullptr;
 }
 
-void CameraServer::pushFrame(CameraType type, FrameReader *fr, const Event *event) {
+void CameraServer::pushFrame(CameraType type, std::shared_ptr<FrameReader> fr, const Event *event) {
   auto &cam = cameras_[type];
   if (cam.width != fr->width || cam.height != fr->height) {
     cam.width = fr->width;
@@ -1,9 +1,10 @@
 #pragma once
 
 #include <memory>
-#include <set>
+#include <mutex>
 #include <tuple>
 #include <utility>
+#include <vector>
 
 #include "msgq/visionipc/visionipc_server.h"
 #include "common/queue.h"
@@ -16,22 +17,31 @@ class CameraServer {
 public:
   CameraServer(std::pair<int, int> camera_size[MAX_CAMERAS] = nullptr);
   ~CameraServer();
-  void pushFrame(CameraType type, FrameReader* fr, const Event *event);
+  // fr shares the ownership of its segment, so frames can be decoded ahead after it is sent
+  void pushFrame(CameraType type, std::shared_ptr<FrameReader> fr, const Event *event);
   void waitForSent();
 
 protected:
+  // decoded frame held by the vipc buffer with the same index
+  struct CachedFrame {
+    int segment = -1;
+    int frame_idx = -1;
+    uint64_t last_used = 0;
+  };
   struct Camera {
     CameraType type;
     VisionStreamType stream_type;
     int width;
     int height;
     std::thread thread;
-    SafeQueue<std::pair<FrameReader*, const Event *>> queue;
-    std::set<VisionBuf *> cached_buf;
+    SafeQueue<std::pair<std::shared_ptr<FrameReader>, const Event *>> queue;
+    std::mutex lock;  // held while using the vipc buffers
+    std::vector<CachedFrame> cached_frames;
+    uint64_t use_count = 0;
   };
   void startVipcServer();
   void cameraThread(Camera &cam);
-  VisionBuf *getFrame(Camera &cam, FrameReader *fr, int32_t segment_id, uint32_t frame_id);
+  VisionBuf *getFrame(Camera &cam, FrameReader *fr, int segment, int frame_idx);
 
   Camera cameras_[MAX_CAMERAS] = {
       {.type = RoadCam, .stream_type = VISION_STREAM_ROAD},
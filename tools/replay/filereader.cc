@@ -1,5 +1,6 @@
 #include "tools/replay/filereader.h"
 
+#include <cstdio>
 #include <fstream>
 
 #include "common/util.h"
@@ -33,6 +34,40 @@ std::string FileReader::read(const std::string &file, std::atomic<bool> *abort)
   return result;
 }
 
+bool FileReader::readStream(const std::string &file, const std::function<bool(const char *, size_t)> &callback,
+                            std::atomic<bool> *abort) {
+  const bool is_remote = file.find("https://") == 0;
+  const std::string local_file = is_remote ? cacheFilePath(file) : file;
+
+  if ((!is_remote || cache_to_local_) && util::file_exists(local_file)) {
+    std::ifstream fs(local_file, std::ios::binary | std::ios::in);
+    std::string buf(1024 * 1024, '\0');
+    while (fs && !(abort && *abort)) {
+      fs.read(buf.data(), buf.size());
+      if (fs.gcount() > 0 && !callback(buf.data(), fs.gcount())) return false;
+    }
+    return fs.eof() && !(abort && *abort);
+  } else if (is_remote) {
+    // write to a temporary file so an interrupted download never ends up in the cache
+    const std::string tmp_file = local_file + ".tmp";
+    std::ofstream fs;
+    if (cache_to_local_) {
+      fs.open(tmp_file, std::ios::binary | std::ios::out);
+    }
+    bool success = httpGetStream(file, [&](const char *data, size_t size) {
+      if (fs.is_open()) fs.write(data, size);
+      return callback(data, size);
+    }, abort);
+
+    if (fs.is_open()) {
+      fs.close();
+      success ? std::rename(tmp_file.c_str(), local_file.c_str()) : std::remove(tmp_file.c_str());
+    }
+    return success;
+  }
+  return false;
+}
+
 std::string FileReader::download(const std::string &url, std::atomic<bool> *abort) {
   for (int i = 0; i <= max_retries_ && !(abort && *abort); ++i) {
     if (i > 0) {
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <atomic>
+#include <functional>
 #include <string>
 
 class FileReader {
@@ -9,6 +10,9 @@ public:
       : cache_to_local_(cache_to_local), chunk_size_(chunk_size), max_retries_(retries) {}
   virtual ~FileReader() {}
   std::string read(const std::string &file, std::atomic<bool> *abort = nullptr);
+  // passes the file to callback in chunks as it is read or downloaded. callback returns false to stop.
+  bool readStream(const std::string &file, const std::function<bool(const char *data, size_t size)> &callback,
+                  std::atomic<bool> *abort = nullptr);
 
 private:
   std::string download(const std::string &url, std::atomic<bool> *abort);
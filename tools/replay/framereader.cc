@@ -1,7 +1,10 @@
 #include "tools/replay/framereader.h"
 
+#include <algorithm>
+#include <atomic>
 #include <map>
 #include <memory>
+#include <thread>
 #include <tuple>
 #include <utility>
 
@@ -19,6 +22,10 @@
 
 namespace {
 
+// there is a software decoder per segment and camera in the cache window, mostly idle. each thread also
+// keeps a frame in flight with frame threading.
+constexpr int MAX_DECODER_THREADS = 4;
+
 enum AVPixelFormat get_hw_format(AVCodecContext *ctx, const enum AVPixelFormat *pix_fmts) {
   enum AVPixelFormat *hw_pix_fmt = reinterpret_cast<enum AVPixelFormat *>(ctx->opaque);
   for (const enum AVPixelFormat *p = pix_fmts; *p != -1; p++) {
@@ -50,10 +57,11 @@ struct DecoderManager {
 };
 
 DecoderManager decoder_manager;
+std::atomic<uint64_t> next_reader_id = 1;
 
 }  // namespace
 
-FrameReader::FrameReader() {
+FrameReader::FrameReader() : id(next_reader_id++) {
   av_log_set_level(AV_LOG_QUIET);
 }
 
@@ -80,7 +88,12 @@ bool FrameReader::loadFromFile(CameraType type, const std::string &file, bool no
   }
   input_ctx->probesize = 10 * 1024 * 1024;  // 10MB
 
-  decoder_ = decoder_manager.acquire(type, input_ctx->streams[0]->codecpar, !no_hw_decoder);
+  if (no_hw_decoder) {
+    cpu_decoder_ = std::make_unique<VideoDecoder>();
+    decoder_ = cpu_decoder_->open(input_ctx->streams[0]->codecpar, false) ? cpu_decoder_.get() : nullptr;
+  } else {
+    decoder_ = decoder_manager.acquire(type, input_ctx->streams[0]->codecpar, true);
+  }
   if (!decoder_) {
     return false;
   }
@@ -133,6 +146,10 @@ bool VideoDecoder::open(AVCodecParameters *codecpar, bool hw_decoder) {
   if (hw_decoder && !initHardwareDecoder(HW_DEVICE_TYPE)) {
     rWarning("No device with hardware decoder found. fallback to CPU decoding.");
   }
+  if (hw_pix_fmt == AV_PIX_FMT_NONE) {
+    decoder_ctx->thread_count = std::clamp<int>(std::thread::hardware_concurrency(), 1, MAX_DECODER_THREADS);
+    decoder_ctx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+  }
 
   if (avcodec_open2(decoder_ctx, decoder, nullptr) < 0) {
     rError("Failed to open codec");
@@ -168,52 +185,61 @@ bool VideoDecoder::initHardwareDecoder(AVHWDeviceType hw_device_type) {
 }
 
 bool VideoDecoder::decode(FrameReader *reader, int idx, VisionBuf *buf) {
-  int from_idx = idx;
-  if (idx != reader->prev_idx + 1) {
-    // seeking to the nearest key frame
-    for (int i = idx; i >= 0; --i) {
-      if (reader->packets_info[i].flags & AV_PKT_FLAG_KEY) {
-        from_idx = i;
-        break;
-      }
-    }
-
-    auto pos = reader->packets_info[from_idx].pos;
-    int ret = avformat_seek_file(reader->input_ctx, 0, pos, pos, pos, AVSEEK_FLAG_BYTE);
-    if (ret < 0) {
-      rError("Failed to seek to byte position %lld: %d", pos, AVERROR(ret));
-      return false;
-    }
-    avcodec_flush_buffers(decoder_ctx);
+  int key_idx = idx;
+  while (key_idx > 0 && !(reader->packets_info[key_idx].flags & AV_PKT_FLAG_KEY)) {
+    --key_idx;
+  }
+  // keep decoding from the current position unless seeking to the nearest key frame skips frames
+  if (reader->id != reader_id_ || idx < received_idx_ || key_idx > received_idx_) {
+    if (!seek(reader, key_idx)) return false;
   }
-  reader->prev_idx = idx;
 
-  bool result = false;
-  AVPacket pkt;
-  for (int i = from_idx; i <= idx; ++i) {
-    if (av_read_frame(reader->input_ctx, &pkt) == 0) {
-      AVFrame *f = decodeFrame(&pkt);
-      if (f && i == idx) {
-        result = copyBuffer(f, buf);
-      }
-      av_packet_unref(&pkt);
-    }
+  AVFrame *f = nullptr;
+  while (received_idx_ <= idx) {
+    if (!(f = receiveFrame(reader))) return false;
   }
-  return result;
+  return copyBuffer(f, buf);
 }
 
-AVFrame *VideoDecoder::decodeFrame(AVPacket *pkt) {
-  int ret = avcodec_send_packet(decoder_ctx, pkt);
+bool VideoDecoder::seek(FrameReader *reader, int idx) {
+  auto pos = reader->packets_info[idx].pos;
+  int ret = avformat_seek_file(reader->input_ctx, 0, pos, pos, pos, AVSEEK_FLAG_BYTE);
   if (ret < 0) {
-    rError("Error sending a packet for decoding: %d", ret);
-    return nullptr;
+    rError("Failed to seek to byte position %lld: %d", pos, AVERROR(ret));
+    reader_id_ = 0;
+    return false;
+  }
+  avcodec_flush_buffers(decoder_ctx);
+  reader_id_ = reader->id;
+  sent_idx_ = received_idx_ = idx;
+  return true;
+}
+
+AVFrame *VideoDecoder::receiveFrame(FrameReader *reader) {
+  int ret = 0;
+  while ((ret = avcodec_receive_frame(decoder_ctx, av_frame_)) == AVERROR(EAGAIN)) {
+    // send the next packet, or drain the decoder after the last one
+    AVPacket pkt;
+    if (sent_idx_ < reader->packets_info.size() && av_read_frame(reader->input_ctx, &pkt) == 0) {
+      ret = avcodec_send_packet(decoder_ctx, &pkt);
+      av_packet_unref(&pkt);
+      ++sent_idx_;
+    } else {
+      ret = avcodec_send_packet(decoder_ctx, nullptr);
+    }
+    if (ret < 0) {
+      rError("Error sending a packet for decoding: %d", ret);
+      reader_id_ = 0;  // seek before decoding again
+      return nullptr;
+    }
   }
 
-  ret = avcodec_receive_frame(decoder_ctx, av_frame_);
   if (ret != 0) {
     rError("avcodec_receive_frame error: %d", ret);
+    reader_id_ = 0;
     return nullptr;
   }
+  ++received_idx_;
 
   if (av_frame_->format == hw_pix_fmt && av_hwframe_transfer_data(hw_frame_, av_frame_, 0) < 0) {
     rError("error transferring frame data from GPU to CPU");
@@ -224,11 +250,8 @@ AVFrame *VideoDecoder::decodeFrame(AVPacket *pkt) {
 
 bool VideoDecoder::copyBuffer(AVFrame *f, VisionBuf *buf) {
   if (hw_pix_fmt == HW_PIX_FMT) {
-    for (int i = 0; i < height/2; i++) {
-      memcpy(buf->y + (i*2 + 0)*buf->stride, f->data[0] + (i*2 + 0)*f->linesize[0], width);
-      memcpy(buf->y + (i*2 + 1)*buf->stride, f->data[0] + (i*2 + 1)*f->linesize[0], width);
-      memcpy(buf->uv + i*buf->stride, f->data[1] + i*f->linesize[1], width);
-    }
+    libyuv::CopyPlane(f->data[0], f->linesize[0], buf->y, buf->stride, width, height);
+    libyuv::CopyPlane(f->data[1], f->linesize[1], buf->uv, buf->stride, width, height / 2);
   } else {
     libyuv::I420ToNV12(f->data[0], f->linesize[0],
                        f->data[1], f->linesize[1],
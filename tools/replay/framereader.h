@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -25,10 +26,12 @@ public:
   size_t getFrameCount() const { return packets_info.size(); }
 
   int width = 0, height = 0;
+  // unique per reader, a new reader can be allocated at the address of a deleted one
+  const uint64_t id;
 
   VideoDecoder *decoder_ = nullptr;
+  std::unique_ptr<VideoDecoder> cpu_decoder_;  // software decoders aren't shared, so segments decode in parallel
   AVFormatContext *input_ctx = nullptr;
-  int prev_idx = -1;
   struct PacketInfo {
     int flags;
     int64_t pos;
@@ -47,9 +50,14 @@ public:
 
 private:
   bool initHardwareDecoder(AVHWDeviceType hw_device_type);
-  AVFrame *decodeFrame(AVPacket *pkt);
+  bool seek(FrameReader *reader, int idx);
+  AVFrame *receiveFrame(FrameReader *reader);
   bool copyBuffer(AVFrame *f, VisionBuf *buf);
 
+  // frame threading delays the output, so packets are sent ahead of the received frames
+  uint64_t reader_id_ = 0;  // FrameReader::id of the decoded packets, 0 if none
+  int sent_idx_ = 0;
+  int received_idx_ = 0;
   AVFrame *av_frame_, *hw_frame_;
   AVCodecContext *decoder_ctx = nullptr;
   AVPixelFormat hw_pix_fmt = AV_PIX_FMT_NONE;
@@ -0,0 +1,133 @@
+#include "tools/replay/logcache.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+
+#include "system/hardware/hw.h"
+
+namespace fs = std::filesystem;
+
+static const std::string &logCacheDir() {
+  static std::string cache_dir = [] {
+    std::string dir = Path::download_cache_root();
+    dir += (dir.back() == '/' ? "" : "/") + std::string("decompressed_logs/");
+    util::create_directories(dir, 0755);
+    return dir;
+  }();
+  return cache_dir;
+}
+
+std::string logCacheFilePath(const std::string &compressed_log) {
+  return logCacheDir() + sha256(compressed_log);
+}
+
+std::unique_ptr<MappedFile> openLogCache(const std::string &file) {
+  auto mapped = std::make_unique<MappedFile>(file);
+  if (!mapped->valid() || mapped->size() < sizeof(LogCacheHeader)) return nullptr;
+
+  LogCacheHeader header;
+  memcpy(&header, mapped->data(), sizeof(header));
+  if (header.magic != LOG_CACHE_MAGIC || header.version != LOG_CACHE_VERSION ||
+      header.num_events > mapped->size() / sizeof(LogCacheEvent) ||
+      header.data_offset < sizeof(header) + header.num_events * sizeof(LogCacheEvent) ||
+      header.data_offset % sizeof(capnp::word) != 0 || header.data_offset + header.data_size != mapped->size()) {
+    rWarning("invalid log cache %s", file.c_str());
+    return nullptr;
+  }
+
+  // the modification time orders the files for eviction
+  utimensat(AT_FDCWD, file.c_str(), nullptr, 0);
+  return mapped;
+}
+
+bool writeLogCache(const std::string &file, const std::string &data, const std::vector<Event> &events) {
+  LogCacheHeader header;
+  header.num_events = events.size();
+  header.data_offset = sizeof(header) + events.size() * sizeof(LogCacheEvent);
+
+  // a truncated log may not end on a word boundary, the appended event data must
+  const size_t data_size = (data.size() + sizeof(capnp::word) - 1) / sizeof(capnp::word) * sizeof(capnp::word);
+  std::vector<LogCacheEvent> table;
+  table.reserve(events.size());
+  std::string extra;
+  for (const auto &e : events) {
+    const char *p = (const char *)e.data.begin();
+    const size_t size = e.data.size() * sizeof(capnp::word);
+    LogCacheEvent &entry = table.emplace_back();
+    entry.mono_time = e.mono_time;
+    entry.size = e.data.size();
+    entry.which = e.which;
+    entry.eidx_segnum = e.eidx_segnum;
+    if (p >= data.data() && p + size <= data.data() + data.size()) {
+      entry.offset = p - data.data();
+    } else {
+      // e.g. migrated events
+      entry.offset = data_size + extra.size();
+      extra.append(p, size);
+    }
+  }
+  header.data_size = data_size + extra.size();
+
+  // write to a temporary file so a partially written cache is never loaded. the name is unique,
+  // other processes may write the cache of the same log at the same time.
+  std::string tmp_file = file + ".XXXXXX.tmp";
+  int fd = mkstemps(tmp_file.data(), 4);
+  if (fd < 0) {
+    rWarning("failed to create log cache %s", tmp_file.c_str());
+    return false;
+  }
+  fchmod(fd, 0644);
+  FILE *f = fdopen(fd, "wb");
+  bool ok = f != nullptr;
+  if (ok) {
+    ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    ok &= fwrite(table.data(), sizeof(LogCacheEvent), table.size(), f) == table.size();
+    ok &= fwrite(data.data(), 1, data.size(), f) == data.size();
+    ok &= fwrite("\0\0\0\0\0\0\0", 1, data_size - data.size(), f) == data_size - data.size();
+    ok &= fwrite(extra.data(), 1, extra.size(), f) == extra.size();
+    ok &= fclose(f) == 0;
+  } else {
+    close(fd);
+  }
+
+  if (!ok || std::rename(tmp_file.c_str(), file.c_str()) != 0) {
+    rWarning("failed to write log cache %s", file.c_str());
+    std::remove(tmp_file.c_str());
+    return false;
+  }
+  return true;
+}
+
+void evictLogCache(size_t size_limit, const std::string &keep_file) {
+  struct CacheFile {
+    fs::path path;
+    fs::file_time_type time;
+    uintmax_t size;
+  };
+  std::vector<CacheFile> files;
+  uintmax_t total_size = 0;
+  std::error_code ec;
+  for (const auto &entry : fs::directory_iterator(logCacheDir(), ec)) {
+    if (entry.is_regular_file(ec) && entry.path().extension() != ".tmp") {
+      auto &f = files.emplace_back(CacheFile{entry.path(), entry.last_write_time(ec), entry.file_size(ec)});
+      total_size += f.size;
+    }
+  }
+
+  std::sort(files.begin(), files.end(), [](auto &a, auto &b) { return a.time < b.time; });
+  for (const auto &f : files) {
+    if (total_size <= size_limit) break;
+    // mappings of removed files stay valid
+    if (f.path != keep_file && fs::remove(f.path, ec)) {
+      rDebug("evicted log cache %s", f.path.c_str());
+      total_size -= f.size;
+    }
+  }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common/util.h"
+#include "tools/replay/logreader.h"
+
+// Decompressed logs are cached on disk together with their sorted event table, keyed by
+// the sha256 of the compressed log. Loading a cached log skips decompression, parsing and sorting:
+//   [LogCacheHeader][num_events x LogCacheEvent][event data]
+
+constexpr uint32_t LOG_CACHE_MAGIC = 0x434C504F;  // "OPLC"
+constexpr uint32_t LOG_CACHE_VERSION = 1;
+
+// least recently used logs are evicted when the cache grows beyond this size
+const size_t LOG_CACHE_SIZE_LIMIT = (size_t)util::getenv("REPLAY_LOG_CACHE_SIZE_MB", 10 * 1024) * 1024 * 1024;
+
+struct LogCacheHeader {
+  uint32_t magic = LOG_CACHE_MAGIC;
+  uint32_t version = LOG_CACHE_VERSION;
+  uint64_t num_events = 0;
+  uint64_t data_offset = 0;  // 8 byte aligned
+  uint64_t data_size = 0;
+};
+
+struct LogCacheEvent {
+  uint64_t mono_time;
+  uint64_t offset;  // bytes from the start of the event data
+  uint32_t size;    // words
+  uint16_t which;
+  uint16_t reserved = 0;
+  int32_t eidx_segnum;
+};
+
+std::string logCacheFilePath(const std::string &compressed_log);
+// maps a cache file and marks it as recently used. returns nullptr if it is missing or invalid.
+std::unique_ptr<MappedFile> openLogCache(const std::string &file);
+// events must be sorted. event data outside of data is appended to the cached data.
+bool writeLogCache(const std::string &file, const std::string &data, const std::vector<Event> &events);
+// removes the least recently used cache files until the cache fits into size_limit
+void evictLogCache(size_t size_limit, const std::string &keep_file = "");
@@ -1,18 +1,143 @@
 #include "tools/replay/logreader.h"
 
+#include <bzlib.h>
+#include <sys/mman.h>
+#include <zstd.h>
+
 #include <algorithm>
+#include <cassert>
+#include <string_view>
 #include <utility>
 #include "tools/replay/filereader.h"
+#include "tools/replay/logcache.h"
 #include "tools/replay/util.h"
 #include "common/util.h"
 
+namespace {
+
+// Incrementally decompresses bz2 or zstd data, uncompressed data is passed through
+class StreamDecompressor {
+public:
+  ~StreamDecompressor() {
+    if (type_ == Type::BZ2) BZ2_bzDecompressEnd(&bz_);
+    if (zstd_) ZSTD_freeDCtx(zstd_);
+  }
+
+  // appends the decompressed data to out, returns false if the content is corrupt
+  bool decompress(const char *in, size_t size, std::string &out) {
+    if (type_ == Type::Unknown) {
+      std::string_view magic(in, std::min<size_t>(size, 4));
+      if (magic == "BZh9") {
+        type_ = Type::BZ2;
+        int bzerror = BZ2_bzDecompressInit(&bz_, 0, 0);
+        assert(bzerror == BZ_OK);
+      } else if (magic == std::string_view("\x28\xB5\x2F\xFD", 4)) {
+        type_ = Type::ZST;
+        zstd_ = ZSTD_createDCtx();
+        assert(zstd_ != nullptr);
+      } else {
+        type_ = Type::Raw;
+      }
+    }
+
+    if (type_ == Type::BZ2) {
+      bz_.next_in = (char *)in;
+      bz_.avail_in = size;
+      while (!bz_finished_ && (bz_.avail_in > 0 || bz_.avail_out == 0)) {
+        size_t prev_size = out.size();
+        out.resize(prev_size + CHUNK_SIZE);
+        bz_.next_out = out.data() + prev_size;
+        bz_.avail_out = CHUNK_SIZE;
+        int bzerror = BZ2_bzDecompress(&bz_);
+        out.resize(prev_size + CHUNK_SIZE - bz_.avail_out);
+        if (bzerror == BZ_STREAM_END) {
+          bz_finished_ = true;
+        } else if (bzerror != BZ_OK) {
+          rWarning("decompressBZ2 error: content is corrupt");
+          return false;
+        }
+      }
+    } else if (type_ == Type::ZST) {
+      ZSTD_inBuffer input = {in, size, 0};
+      bool output_full = false;
+      while (input.pos < input.size || output_full) {
+        size_t prev_size = out.size();
+        out.resize(prev_size + CHUNK_SIZE);
+        ZSTD_outBuffer output = {out.data() + prev_size, CHUNK_SIZE, 0};
+        size_t result = ZSTD_decompressStream(zstd_, &output, &input);
+        out.resize(prev_size + output.pos);
+        if (ZSTD_isError(result)) {
+          rWarning("decompressZST error: content is corrupt");
+          return false;
+        }
+        output_full = output.pos == CHUNK_SIZE;
+      }
+    } else {
+      out.append(in, size);
+    }
+    return true;
+  }
+
+private:
+  enum class Type { Unknown, Raw, BZ2, ZST };
+  static constexpr size_t CHUNK_SIZE = 1024 * 1024;
+  Type type_ = Type::Unknown;
+  bz_stream bz_ = {};
+  bool bz_finished_ = false;
+  ZSTD_DCtx *zstd_ = nullptr;
+};
+
+// Returns the size of the complete messages at the beginning of data
+size_t completeMessagesSize(const std::string &data) {
+  kj::ArrayPtr<const capnp::word> words((const capnp::word *)data.data(), data.size() / sizeof(capnp::word));
+  size_t size = 0;
+  while (size < words.size()) {
+    size_t expected = capnp::expectedSizeInWordsFromPrefix(words.slice(size, words.size()));
+    if (size + expected > words.size()) break;
+    size += expected;
+  }
+  return size * sizeof(capnp::word);
+}
+
+}  // namespace
+
 bool LogReader::load(const std::string &url, std::atomic<bool> *abort, bool local_cache, int chunk_size, int retries) {
+  // uncompressed local logs are parsed in place
+  if (url.find("https://") != 0 && url.find(".bz2") == std::string::npos && url.find(".zst") == std::string::npos) {
+    auto mapped = std::make_unique<MappedFile>(url);
+    std::string_view magic(mapped->data(), mapped->valid() ? std::min<size_t>(mapped->size(), 4) : 0);
+    if (mapped->valid() && magic != "BZh9" && magic != std::string_view("\x28\xB5\x2F\xFD", 4)) {
+      return loadMapped(std::move(mapped), abort);
+    }
+  }
+
   std::string data = FileReader(local_cache, chunk_size, retries).read(url, abort);
-  if (!data.empty()) {
-    if (url.find(".bz2") != std::string::npos || util::starts_with(data, "BZh9")) {
-      data = decompressBZ2(data, abort);
-    } else if (url.find(".zst") != std::string::npos || util::starts_with(data, "\x28\xB5\x2F\xFD")) {
-      data = decompressZST(data, abort);
+  if (data.empty()) return false;
+
+  const bool is_bz2 = url.find(".bz2") != std::string::npos || util::starts_with(data, "BZh9");
+  const bool is_zst = !is_bz2 && (url.find(".zst") != std::string::npos || util::starts_with(data, "\x28\xB5\x2F\xFD"));
+  std::string cache_file;
+  if (local_cache && (is_bz2 || is_zst) && LOG_CACHE_SIZE_LIMIT > 0) {
+    cache_file = logCacheFilePath(data);
+    if (loadCached(cache_file, abort)) {
+      return !events.empty() && !(abort && *abort);
+    }
+  }
+
+  if (is_bz2) {
+    data = decompressBZ2(data, abort);
+  } else if (is_zst) {
+    // the cache holds the whole log
+    data = cache_file.empty() ? decompressWantedFrames(data, abort) : decompressZST(data, abort);
+  }
+
+  if (!cache_file.empty() && !data.empty()) {
+    LogReader log;
+    if (log.load(data.data(), data.size(), abort) && writeLogCache(cache_file, data, log.events)) {
+      evictLogCache(LOG_CACHE_SIZE_LIMIT, cache_file);
+      if (loadCached(cache_file, abort)) {
+        return !events.empty() && !(abort && *abort);
+      }
     }
   }
 
@@ -22,9 +147,117 @@ bool LogReader::load(const std::string &url, std::atomic<bool> *abort, bool loca
   return success;
 }
 
+// Only decompresses the frames that contain wanted events if the log has a frame index
+std::string LogReader::decompressWantedFrames(const std::string &data, std::atomic<bool> *abort) {
+  auto index = filters_.empty() ? std::vector<ZstdFrameIndexEntry>{} : readZstdFrameIndex(data);
+  if (index.empty()) {
+    return decompressZST(data, abort);
+  }
+
+  // skipped frames may contain SelfdriveState
+  if (std::any_of(index.begin(), index.end(), [](auto &f) { return f.hasWhich(cereal::Event::Which::SELFDRIVE_STATE); })) {
+    requires_migration = false;
+  }
+
+  return decompressZSTFrames(data, index, [this](const ZstdFrameIndexEntry &f) {
+    for (size_t i = 0; i < filters_.size(); ++i) {
+      if (filters_[i] && f.hasWhich(i)) return true;
+    }
+    return false;
+  }, abort);
+}
+
+bool LogReader::loadStreaming(const std::string &url, const EventsCallback &callback, std::atomic<bool> *abort,
+                              bool local_cache, int retries) {
+  events.reserve(65000);
+  for (int i = 0; i <= retries && !(abort && *abort); ++i) {
+    if (i > 0) {
+      rWarning("streaming failed, retrying %d", i);
+      events.clear();  // data of the events already passed to callback stays valid in buffer_
+      util::sleep_for(3000);
+    }
+
+    StreamDecompressor decompressor;
+    std::string pending;
+    bool corrupt = false;
+    bool success = FileReader(local_cache).readStream(url, [&](const char *data, size_t size) {
+      if (!decompressor.decompress(data, size, pending)) {
+        corrupt = true;
+        return false;
+      }
+
+      size_t complete = completeMessagesSize(pending);
+      if (complete > 0) {
+        const char *buf = pending.data();
+        if (filters_.empty()) {
+          // events point into the data, move it out of the reused buffer
+          buf = (const char *)memcpy(buffer_.allocate(complete), pending.data(), complete);
+        }
+        corrupt = !parseEvents(buf, complete, true, abort);
+        pending.erase(0, complete);
+        if (callback) callback(events);
+      }
+      return !corrupt;
+    }, abort);
+
+    if (success && !pending.empty()) {
+      rWarning("Failed to parse log : truncated message at the end");
+    }
+    // retry on download errors, keep what was parsed from a corrupt log
+    if (success || corrupt) {
+      return finishLoading(abort);
+    }
+  }
+  return false;
+}
+
+bool LogReader::loadMapped(std::unique_ptr<MappedFile> mapped, std::atomic<bool> *abort) {
+  // events point straight into the mapping, even the filtered ones
+  mapped->advise(MADV_SEQUENTIAL);
+  events.reserve(65000);
+  parseEvents(mapped->data(), mapped->size(), false, abort);
+  mapped->advise(MADV_NORMAL);
+  mapped_ = std::move(mapped);
+  return finishLoading(abort);
+}
+
+bool LogReader::loadCached(const std::string &file, std::atomic<bool> *abort) {
+  if (!util::file_exists(file)) return false;
+  auto mapped = openLogCache(file);
+  if (!mapped) return false;
+
+  LogCacheHeader header;
+  memcpy(&header, mapped->data(), sizeof(header));
+  const LogCacheEvent *begin = (const LogCacheEvent *)(mapped->data() + sizeof(header));
+  const LogCacheEvent *end = begin + header.num_events;
+  const capnp::word *data = (const capnp::word *)(mapped->data() + header.data_offset);
+
+  events.reserve(header.num_events);
+  for (auto it = begin; it != end && !(abort && *abort); ++it) {
+    if (it->offset % sizeof(capnp::word) != 0 || it->offset + it->size * sizeof(capnp::word) > header.data_size) {
+      rWarning("corrupt log cache %s", file.c_str());
+      events.clear();
+      return false;
+    }
+    if (!filters_.empty() && (it->which >= filters_.size() || !filters_[it->which]))
+      continue;
+
+    events.emplace_back((cereal::Event::Which)it->which, it->mono_time,
+                        kj::arrayPtr(data + it->offset / sizeof(capnp::word), it->size), it->eidx_segnum);
+  }
+  events.shrink_to_fit();
+  mapped_ = std::move(mapped);
+  return true;
+}
+
 bool LogReader::load(const char *data, size_t size, std::atomic<bool> *abort) {
+  events.reserve(65000);
+  parseEvents(data, size, true, abort);
+  return finishLoading(abort);
+}
+
+bool LogReader::parseEvents(const char *data, size_t size, bool copy_filtered, std::atomic<bool> *abort) {
   try {
-    events.reserve(65000);
     kj::ArrayPtr<const capnp::word> words((const capnp::word *)data, size / sizeof(capnp::word));
     while (words.size() > 0 && !(abort && *abort)) {
       capnp::FlatArrayMessageReader reader(words);
@@ -36,15 +269,17 @@ bool LogReader::load(const char *data, size_t size, std::atomic<bool> *abort) {
         requires_migration = false;
       }
 
+      uint64_t mono_time = event.getLogMonoTime();
       if (!filters_.empty()) {
         if (which >= filters_.size() || !filters_[which])
           continue;
+      }
+      if (!filters_.empty() && copy_filtered) {
         auto buf = buffer_.allocate(event_data.size() * sizeof(capnp::word));
         memcpy(buf, event_data.begin(), event_data.size() * sizeof(capnp::word));
         event_data = kj::arrayPtr((const capnp::word *)buf, event_data.size());
       }
 
-      uint64_t mono_time = event.getLogMonoTime();
       const Event &evt = events.emplace_back(which, mono_time, event_data);
       // Add encodeIdx packet again as a frame packet for the video stream
       if (evt.which == cereal::Event::ROAD_ENCODE_IDX ||
@@ -59,8 +294,12 @@ bool LogReader::load(const char *data, size_t size, std::atomic<bool> *abort) {
     }
   } catch (const kj::Exception &e) {
     rWarning("Failed to parse log : %s.\nRetrieved %zu events from corrupt log", e.getDescription().cStr(), events.size());
+    return false;
   }
+  return true;
+}
 
+bool LogReader::finishLoading(std::atomic<bool> *abort) {
   if (requires_migration) {
     migrateOldEvents();
   }
@@ -109,7 +348,7 @@ void LogReader::migrateOldEvents() {
       msg.serializeToBuffer(reinterpret_cast<unsigned char *>(buf), buf_size);
 
       // Store the migrated event in the events list
-      auto event_data = kj::arrayPtr(reinterpret_cast<const capnp::word *>(buf), buf_size);
+      auto event_data = kj::arrayPtr(reinterpret_cast<const capnp::word *>(buf), buf_size / sizeof(capnp::word));
       events.emplace_back(new_evt.which(), new_evt.getLogMonoTime(), event_data);
     }
   }
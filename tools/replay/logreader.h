@@ -1,5 +1,7 @@
 #pragma once
 
+#include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -26,16 +28,30 @@ public:
 
 class LogReader {
 public:
+  // called with all events parsed so far (unsorted) each time a chunk of the log is parsed
+  using EventsCallback = std::function<void(const std::vector<Event> &events)>;
+
   LogReader(const std::vector<bool> &filters = {}) { filters_ = filters; }
   bool load(const std::string &url, std::atomic<bool> *abort = nullptr,
             bool local_cache = false, int chunk_size = -1, int retries = 0);
+  // parses events while the log is still being downloaded and decompressed
+  bool loadStreaming(const std::string &url, const EventsCallback &callback, std::atomic<bool> *abort = nullptr,
+                     bool local_cache = false, int retries = 0);
   bool load(const char *data, size_t size, std::atomic<bool> *abort = nullptr);
   std::vector<Event> events;
 
 private:
+  std::string decompressWantedFrames(const std::string &data, std::atomic<bool> *abort);
+  bool loadMapped(std::unique_ptr<MappedFile> mapped, std::atomic<bool> *abort);
+  // returns false if the cache file is missing or invalid
+  bool loadCached(const std::string &file, std::atomic<bool> *abort);
+  // copy_filtered: copy kept events out of data if filters are set, because data doesn't outlive the reader
+  bool parseEvents(const char *data, size_t size, bool copy_filtered, std::atomic<bool> *abort);
+  bool finishLoading(std::atomic<bool> *abort);
   void migrateOldEvents();
 
   std::string raw_;
+  std::unique_ptr<MappedFile> mapped_;
   bool requires_migration = true;
   std::vector<bool> filters_;
   MonotonicBuffer buffer_{1024 * 1024};
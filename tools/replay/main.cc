@@ -1,7 +1,9 @@
 #include <getopt.h>
 
+#include <future>
 #include <iostream>
 #include <map>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -29,6 +31,8 @@ Options:
       --no-hw-decoder Disable HW video decoding
       --no-vipc      Do not output video
       --all          Output all messages including uiDebug, userFlag
+      --batch        Headless, publish as fast as possible until the end of the route
+      --lockstep     Services to send only after all their readers received the previous message (comma-separated)
   -h, --help         Show this help message
 )";
 
@@ -36,6 +40,7 @@ struct ReplayConfig {
   std::string route;
   std::vector<std::string> allow;
   std::vector<std::string> block;
+  std::vector<std::string> lockstep;
   std::string data_dir;
   std::string prefix;
   uint32_t flags = REPLAY_FLAG_NONE;
@@ -62,6 +67,8 @@ bool parseArgs(int argc, char *argv[], ReplayConfig &config) {
       {"no-hw-decoder", no_argument, nullptr, 0},
       {"no-vipc", no_argument, nullptr, 0},
       {"all", no_argument, nullptr, 0},
+      {"batch", no_argument, nullptr, 0},
+      {"lockstep", required_argument, nullptr, 0},
       {"help", no_argument, nullptr, 'h'},
       {nullptr, 0, nullptr, 0},  // Terminating entry
   };
@@ -75,6 +82,7 @@ bool parseArgs(int argc, char *argv[], ReplayConfig &config) {
       {"no-hw-decoder", REPLAY_FLAG_NO_HW_DECODER},
       {"no-vipc", REPLAY_FLAG_NO_VIPC},
       {"all", REPLAY_FLAG_ALL_SERVICES},
+      {"batch", REPLAY_FLAG_BATCH},
   };
 
   if (argc == 1) {
@@ -96,6 +104,8 @@ bool parseArgs(int argc, char *argv[], ReplayConfig &config) {
         std::string name = cli_options[option_index].name;
         if (name == "demo") {
           config.route = DEMO_ROUTE;
+        } else if (name == "lockstep") {
+          config.lockstep = split(optarg, ',');
         } else {
           config.flags |= flag_map.at(name);
         }
@@ -143,10 +153,22 @@ int main(int argc, char *argv[]) {
   if (config.playback_speed > 0) {
     replay.setSpeed(std::clamp(config.playback_speed, ConsoleUI::speed_array.front(), ConsoleUI::speed_array.back()));
   }
+  if (!config.lockstep.empty()) {
+    replay.setLockstepServices(config.lockstep);
+  }
   if (!replay.load()) {
     return 1;
   }
 
+  if (config.flags & REPLAY_FLAG_BATCH) {
+    std::promise<void> finished;
+    std::once_flag finished_flag;
+    replay.onBatchFinished = [&]() { std::call_once(finished_flag, [&]() { finished.set_value(); }); };
+    replay.start(config.start_seconds);
+    finished.get_future().wait();
+    return 0;
+  }
+
   ConsoleUI console_ui(&replay);
   replay.start(config.start_seconds);
   return console_ui.exec();
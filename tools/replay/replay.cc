@@ -19,6 +19,9 @@ Replay::Replay(const std::string &route, std::vector<std::string> allow, std::ve
     : sm_(sm), flags_(flags), seg_mgr_(std::make_unique<SegmentManager>(route, flags, data_dir)) {
   std::signal(SIGUSR1, interrupt_sleep_handler);
 
+  if (flags_ & REPLAY_FLAG_BATCH) {
+    flags_ |= REPLAY_FLAG_NO_LOOP;
+  }
   if (!(flags_ & REPLAY_FLAG_ALL_SERVICES)) {
     block.insert(block.end(), {"uiDebug", "userFlag"});
   }
@@ -46,6 +49,13 @@ void Replay::setupServices(const std::vector<std::string> &allow, const std::vec
   }
 }
 
+void Replay::setLockstepServices(const std::vector<std::string> &services) {
+  lockstep_.assign(sockets_.size(), false);
+  for (size_t i = 0; i < sockets_.size(); ++i) {
+    lockstep_[i] = sockets_[i] && std::find(services.begin(), services.end(), sockets_[i]) != services.end();
+  }
+}
+
 void Replay::setupSegmentManager(bool has_filters) {
   seg_mgr_->setCallback([this]() { handleSegmentMerge(); });
 
@@ -119,7 +129,16 @@ void Replay::seekTo(double seconds, bool relative) {
 }
 
 void Replay::checkSeekProgress() {
-  if (!seg_mgr_->getEventData()->isSegmentLoaded(current_segment_.load())) return;
+  const auto event_data = seg_mgr_->getEventData();
+  const int segment = current_segment_.load();
+  if (!event_data->isSegmentLoaded(segment)) {
+    // the first seconds of a partially loaded segment only do for a seek into them
+    auto partial = event_data->partial_segments.find(segment);
+    if (partial == event_data->partial_segments.end()) return;
+
+    double target = seeking_to_.load(std::memory_order_acquire);
+    if (target >= 0 && toSeconds(partial->second->mono_time) < target) return;
+  }
 
   double seek_to = seeking_to_.exchange(-1.0, std::memory_order_acquire);
   if (seek_to >= 0 && onSeekedTo) {
@@ -161,7 +180,8 @@ void Replay::handleSegmentMerge() {
 }
 
 void Replay::startStream(const std::shared_ptr<Segment> segment) {
-  const auto &events = segment->log->events;
+  const auto segment_events = segment->events();
+  const auto &events = *segment_events;
   route_start_ts_ = events.front().mono_time;
   cur_mono_time_ += route_start_ts_ - 1;
 
@@ -199,7 +219,7 @@ void Replay::startStream(const std::shared_ptr<Segment> segment) {
   if (!hasFlag(REPLAY_FLAG_NO_VIPC)) {
     std::pair<int, int> camera_size[MAX_CAMERAS] = {};
     for (auto type : ALL_CAMERAS) {
-      if (auto &fr = segment->frames[type]) {
+      if (auto fr = segment->frameReader(type)) {
         camera_size[type] = {fr->width, fr->height};
       }
     }
@@ -216,6 +236,9 @@ void Replay::publishMessage(const Event *e) {
   if (event_filter_ && event_filter_(e)) return;
 
   if (!sm_) {
+    if (!lockstep_.empty() && lockstep_[e->which]) {
+      waitForReaders(e->which);
+    }
     auto bytes = e->data.asBytes();
     int ret = pm_->send(sockets_[e->which], (capnp::byte *)bytes.begin(), bytes.size());
     if (ret == -1) {
@@ -227,6 +250,20 @@ void Replay::publishMessage(const Event *e) {
     auto event = reader.getRoot<cereal::Event>();
     sm_->update_msgs(nanos_since_boot(), {{sockets_[e->which], event}});
   }
+  ++published_events_;
+}
+
+void Replay::waitForReaders(cereal::Event::Which which) {
+  const uint64_t start_ts = nanos_since_boot();
+  while (!pm_->all_readers_updated(sockets_[which]) && !interrupt_requested_) {
+    if (nanos_since_boot() - start_ts > LOCKSTEP_TIMEOUT_SECONDS * 1e9) {
+      // a reader exited or got stuck, don't block the whole replay on it
+      rWarning("readers of %s did not update in %d seconds, stop waiting for them", sockets_[which], LOCKSTEP_TIMEOUT_SECONDS);
+      lockstep_[which] = false;
+      break;
+    }
+    precise_nano_sleep(50 * 1000, interrupt_requested_);
+  }
 }
 
 void Replay::publishFrame(const Event *e) {
@@ -243,8 +280,9 @@ void Replay::publishFrame(const Event *e) {
 
   auto seg_it = event_data_->segments.find(e->eidx_segnum);
   if (seg_it != event_data_->segments.end()) {
-    if (auto &frame = seg_it->second->frames[cam]; frame) {
-      camera_server_->pushFrame(cam, frame.get(), e);
+    if (auto frame = seg_it->second->frameReader(cam)) {
+      camera_server_->pushFrame(cam, std::shared_ptr<FrameReader>(seg_it->second, frame), e);
+      ++published_frames_;
     }
   }
 }
@@ -258,41 +296,49 @@ void Replay::streamThread() {
     if (exit_) break;
 
     event_data_ = seg_mgr_->getEventData();
-    const auto &events = event_data_->events;
-    auto first = std::upper_bound(events.cbegin(), events.cend(), Event(cur_which_, cur_mono_time_, {}));
-    if (first == events.cend()) {
+    const Event cur_event(cur_which_, cur_mono_time_, {});
+    MergedEventIterator it(event_data_->event_ranges, cur_event, event_data_->iterationEnd(cur_event));
+    if (it.done()) {
       rInfo("waiting for events...");
       events_ready_ = false;
       continue;
     }
 
-    auto it = publishEvents(first, events.cend());
+    publishEvents(it);
 
     // Ensure frames are sent before unlocking to prevent race conditions
     if (camera_server_) {
       camera_server_->waitForSent();
     }
 
-    if (it == events.cend() && !hasFlag(REPLAY_FLAG_NO_LOOP)) {
-      int last_segment = seg_mgr_->route_.segments().rbegin()->first;
-      if (event_data_->isSegmentLoaded(last_segment)) {
-        rInfo("reaches the end of route, restart from beginning");
-        stream_lock_.unlock();
-        seekTo(minSeconds(), false);
-        stream_lock_.lock();
+    // the end of route, once no segment is left to load. failed segments are skipped.
+    if (it.done() && event_data_->loading_segments.empty()) {
+      int last_segment = seg_mgr_->lastSegment();
+      if (event_data_->isSegmentLoaded(last_segment) || event_data_->isSegmentFailed(last_segment)) {
+        if (hasFlag(REPLAY_FLAG_BATCH)) {
+          reportThroughput();
+          if (!event_data_->failed_segments.empty()) {
+            rWarning("batch: failed to load segments %s", join(event_data_->failed_segments, ", ").c_str());
+          }
+          notifyEvent(onBatchFinished);
+        } else if (!hasFlag(REPLAY_FLAG_NO_LOOP)) {
+          rInfo("reaches the end of route, restart from beginning");
+          stream_lock_.unlock();
+          seekTo(minSeconds(), false);
+          stream_lock_.lock();
+        }
       }
     }
   }
 }
 
-std::vector<Event>::const_iterator Replay::publishEvents(std::vector<Event>::const_iterator first,
-                                                         std::vector<Event>::const_iterator last) {
+void Replay::publishEvents(MergedEventIterator &it) {
   uint64_t evt_start_ts = cur_mono_time_;
   uint64_t loop_start_ts = nanos_since_boot();
   double prev_replay_speed = speed_;
 
-  for (; !interrupt_requested_ && first != last; ++first) {
-    const Event &evt = *first;
+  for (; !interrupt_requested_ && !it.done(); ++it) {
+    const Event &evt = *it;
 
     int segment = toSeconds(evt.mono_time) / 60;
     if (current_segment_.load(std::memory_order_relaxed) != segment) {
@@ -307,17 +353,23 @@ std::vector<Event>::const_iterator Replay::publishEvents(std::vector<Event>::con
     if (!sockets_[evt.which]) continue;
 
     const uint64_t current_nanos = nanos_since_boot();
-    const int64_t time_diff = (evt.mono_time - evt_start_ts) / speed_ - (current_nanos - loop_start_ts);
-
-    // Reset timestamps for potential synchronization issues:
-    // - A negative time_diff may indicate slow execution or system wake-up,
-    // - A time_diff exceeding 1 second suggests a skipped segment.
-    if ((time_diff < -1e9 || time_diff >= 1e9) || speed_ != prev_replay_speed) {
-      evt_start_ts = evt.mono_time;
-      loop_start_ts = current_nanos;
-      prev_replay_speed = speed_;
-    } else if (time_diff > 0) {
-      precise_nano_sleep(time_diff, interrupt_requested_);
+    if (hasFlag(REPLAY_FLAG_BATCH)) {
+      // no wall clock pacing, the readers of lockstep services apply backpressure
+      if (batch_start_ts_ == 0) batch_start_ts_ = last_report_ts_ = current_nanos;
+      if (current_nanos - last_report_ts_ >= 10e9) reportThroughput();
+    } else {
+      const int64_t time_diff = (evt.mono_time - evt_start_ts) / speed_ - (current_nanos - loop_start_ts);
+
+      // Reset timestamps for potential synchronization issues:
+      // - A negative time_diff may indicate slow execution or system wake-up,
+      // - A time_diff exceeding 1 second suggests a skipped segment.
+      if ((time_diff < -1e9 || time_diff >= 1e9) || speed_ != prev_replay_speed) {
+        evt_start_ts = evt.mono_time;
+        loop_start_ts = current_nanos;
+        prev_replay_speed = speed_;
+      } else if (time_diff > 0) {
+        precise_nano_sleep(time_diff, interrupt_requested_);
+      }
     }
 
     if (interrupt_requested_) break;
@@ -325,12 +377,18 @@ std::vector<Event>::const_iterator Replay::publishEvents(std::vector<Event>::con
     if (evt.eidx_segnum == -1) {
       publishMessage(&evt);
     } else if (camera_server_) {
-      if (speed_ > 1.0) {
+      if (speed_ > 1.0 || hasFlag(REPLAY_FLAG_BATCH)) {
         camera_server_->waitForSent();
       }
       publishFrame(&evt);
     }
   }
+}
 
-  return first;
+void Replay::reportThroughput() {
+  uint64_t now = nanos_since_boot();
+  double elapsed = std::max(now - batch_start_ts_, uint64_t(1)) / 1e9;
+  rInfo("batch: at %.1f s after %.1f s, %.0f events/s, %.1f frames/s", currentSeconds(), elapsed,
+        published_events_ / elapsed, published_frames_ / elapsed);
+  last_report_ts_ = now;
 }
@@ -14,6 +14,9 @@
 
 #define DEMO_ROUTE "a2a0ccea32023010|2023-07-27--13-01-19"
 
+// a lockstep service whose readers don't update in this time is published without waiting
+constexpr int LOCKSTEP_TIMEOUT_SECONDS = 10;
+
 enum REPLAY_FLAGS {
   REPLAY_FLAG_NONE = 0x0000,
   REPLAY_FLAG_DCAM = 0x0002,
@@ -24,6 +27,7 @@ enum REPLAY_FLAGS {
   REPLAY_FLAG_NO_HW_DECODER = 0x0100,
   REPLAY_FLAG_NO_VIPC = 0x0400,
   REPLAY_FLAG_ALL_SERVICES = 0x0800,
+  REPLAY_FLAG_BATCH = 0x1000,
 };
 
 class Replay {
@@ -57,12 +61,15 @@ public:
   inline const std::optional<Timeline::Entry> findAlertAtTime(double sec) const { return timeline_.findAlertAtTime(sec); }
   const std::shared_ptr<SegmentManager::EventData> getEventData() const { return seg_mgr_->getEventData(); }
   void installEventFilter(std::function<bool(const Event *)> filter) { event_filter_ = filter; }
+  // messages of these services are only sent once all readers have read the previous one
+  void setLockstepServices(const std::vector<std::string> &services);
 
   // Event callback functions
   std::function<void()> onSegmentsMerged = nullptr;
   std::function<void(double)> onSeeking = nullptr;
   std::function<void(double)> onSeekedTo = nullptr;
   std::function<void(std::shared_ptr<LogReader>)> onQLogLoaded = nullptr;
+  std::function<void()> onBatchFinished = nullptr;
 
 private:
   void setupServices(const std::vector<std::string> &allow, const std::vector<std::string> &block);
@@ -71,11 +78,12 @@ private:
   void streamThread();
   void handleSegmentMerge();
   void interruptStream(const std::function<bool()>& update_fn);
-  std::vector<Event>::const_iterator publishEvents(std::vector<Event>::const_iterator first,
-                                                   std::vector<Event>::const_iterator last);
+  void publishEvents(MergedEventIterator &it);
   void publishMessage(const Event *e);
   void publishFrame(const Event *e);
   void checkSeekProgress();
+  void waitForReaders(cereal::Event::Which which);
+  void reportThroughput();
 
   std::unique_ptr<SegmentManager> seg_mgr_;
   Timeline timeline_;
@@ -105,6 +113,13 @@ private:
   std::string car_fingerprint_;
   std::atomic<float> speed_ = 1.0;
   std::function<bool(const Event *)> event_filter_ = nullptr;
+  std::vector<bool> lockstep_;
+
+  // batch mode throughput
+  std::atomic<uint64_t> published_events_ = 0;
+  std::atomic<uint64_t> published_frames_ = 0;
+  uint64_t batch_start_ts_ = 0;
+  uint64_t last_report_ts_ = 0;
 
   std::shared_ptr<SegmentManager::EventData> event_data_ = std::make_shared<SegmentManager::EventData>();
 };
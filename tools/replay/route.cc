@@ -1,8 +1,10 @@
 #include "tools/replay/route.h"
 
+#include <algorithm>
 #include <array>
 #include <filesystem>
 #include <regex>
+#include <tuple>
 
 #include "third_party/json11/json11.hpp"
 #include "system/hardware/hw.h"
@@ -155,11 +157,77 @@ void Route::addFileToSegment(int n, const std::string &file) {
   }
 }
 
+// class SegmentLoadPool
+
+SegmentLoadPool::SegmentLoadPool(int num_threads) {
+  for (int i = 0; i < num_threads; ++i) {
+    threads_.emplace_back(&SegmentLoadPool::workerThread, this);
+  }
+}
+
+SegmentLoadPool::~SegmentLoadPool() {
+  {
+    std::lock_guard lock(mutex_);
+    exit_ = true;
+  }
+  cv_.notify_all();
+  for (auto &thread : threads_) {
+    thread.join();
+  }
+}
+
+void SegmentLoadPool::push(const void *owner, int priority, std::function<void()> job) {
+  {
+    std::lock_guard lock(mutex_);
+    pending_.push_back({owner, priority, seq_++, std::move(job)});
+  }
+  cv_.notify_one();
+}
+
+void SegmentLoadPool::setPriority(const void *owner, int priority) {
+  std::lock_guard lock(mutex_);
+  for (auto &job : pending_) {
+    if (job.owner == owner) job.priority = priority;
+  }
+}
+
+void SegmentLoadPool::cancel(const void *owner) {
+  std::unique_lock lock(mutex_);
+  pending_.erase(std::remove_if(pending_.begin(), pending_.end(), [=](auto &job) { return job.owner == owner; }),
+                 pending_.end());
+  done_cv_.wait(lock, [=]() { return running_.count(owner) == 0; });
+}
+
+void SegmentLoadPool::workerThread() {
+  util::set_thread_name("replay_seg_load");
+  std::unique_lock lock(mutex_);
+  while (true) {
+    cv_.wait(lock, [this]() { return exit_ || !pending_.empty(); });
+    if (exit_) break;
+
+    auto it = std::min_element(pending_.begin(), pending_.end(), [](auto &a, auto &b) {
+      return std::tie(a.priority, a.seq) < std::tie(b.priority, b.seq);
+    });
+    Job job = std::move(*it);
+    pending_.erase(it);
+    ++running_[job.owner];
+
+    lock.unlock();
+    job.run();
+    lock.lock();
+
+    if (--running_[job.owner] == 0) {
+      running_.erase(job.owner);
+      done_cv_.notify_all();
+    }
+  }
+}
+
 // class Segment
 
 Segment::Segment(int n, const SegmentFile &files, uint32_t flags, const std::vector<bool> &filters,
-                 std::function<void(int, bool)> callback)
-    : seg_num(n), flags(flags), filters_(filters), on_load_finished_(callback) {
+                 std::function<void(int, bool)> callback, std::shared_ptr<SegmentLoadPool> pool, int priority)
+    : seg_num(n), flags(flags), filters_(filters), pool_(pool), on_load_finished_(callback) {
   // [RoadCam, DriverCam, WideRoadCam, log]. fallback to qcamera/qlog
   const std::array file_list = {
       (flags & REPLAY_FLAG_QCAMERA) || files.road_cam.empty() ? files.qcamera : files.road_cam,
@@ -167,12 +235,17 @@ Segment::Segment(int n, const SegmentFile &files, uint32_t flags, const std::vec
       flags & REPLAY_FLAG_ECAM ? files.wide_road_cam : "",
       files.rlog.empty() ? files.qlog : files.rlog,
   };
+  std::vector<int> file_ids;
   for (int i = 0; i < file_list.size(); ++i) {
     if (!file_list[i].empty() && (!(flags & REPLAY_FLAG_NO_VIPC) || i >= MAX_CAMERAS)) {
-      ++loading_;
-      threads_.emplace_back(&Segment::loadFile, this, i, file_list[i]);
+      file_ids.push_back(i);
     }
   }
+  // count all files before any job can finish
+  loading_ = file_ids.size();
+  for (int i : file_ids) {
+    pool_->push(this, priority, [this, i, file = file_list[i]]() { loadFile(i, file); });
+  }
 }
 
 Segment::~Segment() {
@@ -181,20 +254,30 @@ Segment::~Segment() {
     on_load_finished_ = nullptr;  // Prevent callback after destruction
   }
   abort_ = true;
-  for (auto &thread : threads_) {
-    if (thread.joinable()) thread.join();
-  }
+  pool_->cancel(this);
 }
 
 void Segment::loadFile(int id, const std::string file) {
   const bool local_cache = !(flags & REPLAY_FLAG_NO_FILE_CACHE);
   bool success = false;
   if (id < MAX_CAMERAS) {
-    frames[id] = std::make_unique<FrameReader>();
-    success = frames[id]->load((CameraType)id, file, flags & REPLAY_FLAG_NO_HW_DECODER, &abort_, local_cache, 20 * 1024 * 1024, 3);
+    auto frame_reader = std::make_unique<FrameReader>();
+    success = frame_reader->load((CameraType)id, file, flags & REPLAY_FLAG_NO_HW_DECODER, &abort_, local_cache, 20 * 1024 * 1024, 3);
+    std::lock_guard lock(mutex_);
+    frames_[id] = std::move(frame_reader);
   } else {
     log = std::make_unique<LogReader>(filters_);
-    success = log->load(file, &abort_, local_cache, 0, 3);
+    if (file.find("https://") == 0 && !(local_cache && util::file_exists(cacheFilePath(file)))) {
+      // stream the download, so the first seconds can be replayed before the whole log has arrived
+      success = log->loadStreaming(file, [this](const std::vector<Event> &events) { onLogEvents(events); },
+                                   &abort_, local_cache, 3);
+    } else {
+      success = log->load(file, &abort_, local_cache, 0, 3);
+    }
+    if (success && !abort_ && loading_ > 1) {
+      // the frame readers are still loading, the whole log can be replayed meanwhile
+      publishPartialEvents(std::shared_ptr<const std::vector<Event>>(std::shared_ptr<void>(), &log->events));
+    }
   }
 
   if (!success) {
@@ -205,13 +288,49 @@ void Segment::loadFile(int id, const std::string file) {
   if (--loading_ == 0) {
     std::lock_guard lock(mutex_);
     load_state_ = !abort_ ? LoadState::Loaded : LoadState::Failed;
+    partial_events_ = nullptr;
     if (on_load_finished_) {
       on_load_finished_(seg_num, !abort_);
     }
   }
 }
 
+void Segment::onLogEvents(const std::vector<Event> &events) {
+  // publish once the first seconds are parsed, the frame readers may still be loading
+  if (partial_events_ || events.empty() ||
+      events.back().mono_time < events.front().mono_time + PARTIAL_SEGMENT_SECONDS * 1e9) {
+    return;
+  }
+
+  auto partial_events = std::make_shared<std::vector<Event>>(events);
+  std::sort(partial_events->begin(), partial_events->end());
+  publishPartialEvents(partial_events);
+}
+
+void Segment::publishPartialEvents(std::shared_ptr<const std::vector<Event>> events) {
+  std::lock_guard lock(mutex_);
+  partial_events_ = std::move(events);
+  load_state_ = LoadState::PartiallyLoaded;
+  if (on_load_finished_) {
+    on_load_finished_(seg_num, true);
+  }
+}
+
 Segment::LoadState Segment::getState() {
   std::scoped_lock lock(mutex_);
   return load_state_;
 }
+
+std::shared_ptr<const std::vector<Event>> Segment::events() {
+  std::scoped_lock lock(mutex_);
+  if (load_state_ == LoadState::Loaded) {
+    // owned by the segment
+    return std::shared_ptr<const std::vector<Event>>(std::shared_ptr<void>(), &log->events);
+  }
+  return partial_events_ ? partial_events_ : std::make_shared<const std::vector<Event>>();
+}
+
+FrameReader *Segment::frameReader(CameraType type) {
+  std::scoped_lock lock(mutex_);
+  return frames_[type].get();
+}
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <condition_variable>
 #include <ctime>
+#include <functional>
 #include <map>
 #include <memory>
 #include <mutex>
@@ -63,28 +65,69 @@ protected:
   RouteLoadError err_ = RouteLoadError::None;
 };
 
+// Runs the file loading jobs of segments on a bounded number of threads.
+// Pending jobs with the lowest priority value run first, in submission order.
+class SegmentLoadPool {
+public:
+  SegmentLoadPool(int num_threads);
+  ~SegmentLoadPool();
+  void push(const void *owner, int priority, std::function<void()> job);
+  void setPriority(const void *owner, int priority);
+  // drops the pending jobs of owner and waits for its running jobs to finish
+  void cancel(const void *owner);
+
+private:
+  struct Job {
+    const void *owner;
+    int priority;
+    uint64_t seq;
+    std::function<void()> run;
+  };
+  void workerThread();
+
+  std::mutex mutex_;
+  std::condition_variable cv_, done_cv_;
+  std::vector<Job> pending_;
+  std::map<const void *, int> running_;  // owner -> running job count
+  std::vector<std::thread> threads_;
+  uint64_t seq_ = 0;
+  bool exit_ = false;
+};
+
+// a segment that is still downloading its log is merged once this many seconds are parsed
+constexpr int PARTIAL_SEGMENT_SECONDS = 5;
+
 class Segment {
 public:
-  enum class LoadState {Loading, Loaded, Failed};
+  enum class LoadState {Loading, PartiallyLoaded, Loaded, Failed};
 
   Segment(int n, const SegmentFile &files, uint32_t flags, const std::vector<bool> &filters,
-          std::function<void(int, bool)> callback);
+          std::function<void(int, bool)> callback, std::shared_ptr<SegmentLoadPool> pool, int priority = 0);
   ~Segment();
   LoadState getState();
+  void setPriority(int priority) { pool_->setPriority(this, priority); }
+  // all events once loaded, or the sorted events parsed so far while partially loaded.
+  // the partial events are released once the segment is loaded, the returned pointer keeps them.
+  std::shared_ptr<const std::vector<Event>> events();
+  // the frame reader of the camera once it is loaded, the log may be partially loaded before
+  FrameReader *frameReader(CameraType type);
 
   const int seg_num = 0;
   std::unique_ptr<LogReader> log;
-  std::unique_ptr<FrameReader> frames[MAX_CAMERAS] = {};
 
 protected:
   void loadFile(int id, const std::string file);
+  void onLogEvents(const std::vector<Event> &events);
+  void publishPartialEvents(std::shared_ptr<const std::vector<Event>> events);
 
   std::atomic<bool> abort_ = false;
   std::atomic<int> loading_ = 0;
   std::mutex mutex_;
-  std::vector<std::thread> threads_;
+  std::shared_ptr<SegmentLoadPool> pool_;
   std::function<void(int, bool)> on_load_finished_ = nullptr;
   uint32_t flags;
   std::vector<bool> filters_;
   LoadState load_state_  = LoadState::Loading;
+  std::shared_ptr<const std::vector<Event>> partial_events_;
+  std::unique_ptr<FrameReader> frames_[MAX_CAMERAS] = {};
 };
@@ -1,6 +1,45 @@
 #include "tools/replay/seg_mgr.h"
 
 #include <algorithm>
+#include <thread>
+
+// class MergedEventIterator
+
+MergedEventIterator::MergedEventIterator(const std::vector<Range> &ranges, const Event &after, const Event *last) {
+  heap_.reserve(ranges.size());
+  for (auto [begin, end] : ranges) {
+    if (last) end = std::upper_bound(begin, end, *last);
+    auto first = std::upper_bound(begin, end, after);
+    if (first != end) heap_.emplace_back(first, end);
+  }
+  std::make_heap(heap_.begin(), heap_.end(), greater);
+}
+
+MergedEventIterator &MergedEventIterator::operator++() {
+  // the ranges hardly overlap, so the next event mostly comes from the same range
+  std::pop_heap(heap_.begin(), heap_.end(), greater);
+  if (++heap_.back().first != heap_.back().second) {
+    std::push_heap(heap_.begin(), heap_.end(), greater);
+  } else {
+    heap_.pop_back();
+  }
+  return *this;
+}
+
+// class SegmentManager
+
+const Event *SegmentManager::EventData::iterationEnd(const Event &after) const {
+  for (const auto &[n, last] : partial_segments) {
+    if (!(*last < after)) return last;
+  }
+  return nullptr;
+}
+
+SegmentManager::SegmentManager(const std::string &route_name, uint32_t flags, const std::string &data_dir)
+    : flags_(flags), route_(route_name, data_dir), event_data_(std::make_shared<EventData>()) {
+  // segments are shared with the event data, which may outlive the manager, so they share the pool
+  load_pool_ = std::make_shared<SegmentLoadPool>(std::max(4u, std::thread::hardware_concurrency()));
+}
 
 SegmentManager::~SegmentManager() {
   {
@@ -75,66 +114,80 @@ void SegmentManager::manageSegmentCache() {
 }
 
 bool SegmentManager::mergeSegments(const SegmentMap::iterator &begin, const SegmentMap::iterator &end) {
-  std::set<int> segments_to_merge;
-  size_t total_event_count = 0;
+  std::map<int, size_t> segments_to_merge;
+  std::set<int> partial_segments, loading_segments, failed_segments;
   for (auto it = begin; it != end; ++it) {
     const auto &segment = it->second;
-    if (segment && segment->getState() == Segment::LoadState::Loaded) {
-      segments_to_merge.insert(segment->seg_num);
-      total_event_count += segment->log->events.size();
+    if (!segment) continue;
+
+    auto state = segment->getState();
+    if (state == Segment::LoadState::Loaded || state == Segment::LoadState::PartiallyLoaded) {
+      segments_to_merge[segment->seg_num] = segment->events()->size();
+    }
+    if (state == Segment::LoadState::PartiallyLoaded) {
+      partial_segments.insert(segment->seg_num);
+    }
+    if (state == Segment::LoadState::Loading || state == Segment::LoadState::PartiallyLoaded) {
+      loading_segments.insert(segment->seg_num);
+    } else if (state == Segment::LoadState::Failed) {
+      failed_segments.insert(segment->seg_num);
     }
   }
 
-  if (segments_to_merge == merged_segments_) return false;
+  if (segments_to_merge == merged_segments_ && loading_segments == loading_segments_ && failed_segments == failed_segments_) {
+    return false;
+  }
 
+  // segments keep their own sorted events, only the ranges are collected
   auto merged_event_data = std::make_shared<EventData>();
-  auto &merged_events = merged_event_data->events;
-  merged_events.reserve(total_event_count);
+  std::vector<int> segment_nums;
+  for (const auto &[n, _] : segments_to_merge) segment_nums.push_back(n);
+  rDebug("merging segments: %s", join(segment_nums, ", ").c_str());
 
-  rDebug("merging segments: %s", join(segments_to_merge, ", ").c_str());
-  for (int n : segments_to_merge) {
-    const auto &events = segments_.at(n)->log->events;
-    if (events.empty()) continue;
+  for (int n : segment_nums) {
+    auto events = segments_.at(n)->events();
+    if (events->empty()) continue;
 
     // Skip INIT_DATA if present
-    auto events_begin = (events.front().which == cereal::Event::Which::INIT_DATA) ? std::next(events.begin()) : events.begin();
-
-    size_t previous_size = merged_events.size();
-    merged_events.insert(merged_events.end(), events_begin, events.end());
-    std::inplace_merge(merged_events.begin(), merged_events.begin() + previous_size, merged_events.end());
-
+    size_t first = (events->front().which == cereal::Event::Which::INIT_DATA) ? 1 : 0;
+    merged_event_data->event_ranges.emplace_back(events->data() + first, events->data() + events->size());
     merged_event_data->segments[n] = segments_.at(n);
+    if (partial_segments.count(n)) {
+      merged_event_data->partial_segments[n] = &events->back();
+    }
+    merged_event_data->segment_events.push_back(std::move(events));
   }
+  merged_event_data->loading_segments = loading_segments;
+  merged_event_data->failed_segments = failed_segments;
 
   std::atomic_store(&event_data_, std::move(merged_event_data));
   merged_segments_ = segments_to_merge;
+  loading_segments_ = std::move(loading_segments);
+  failed_segments_ = std::move(failed_segments);
 
   return true;
 }
 
 void SegmentManager::loadSegmentsInRange(SegmentMap::iterator begin, SegmentMap::iterator cur, SegmentMap::iterator end) {
-  auto tryLoadSegment = [this](auto first, auto last) {
-    for (auto it = first; it != last; ++it) {
-      auto &segment_ptr = it->second;
-      if (!segment_ptr) {
-        segment_ptr = std::make_shared<Segment>(
-            it->first, route_.at(it->first), flags_, filters_,
-            [this](int seg_num, bool success) {
-              std::unique_lock lock(mutex_);
-              needs_update_ = true;
-              cv_.notify_one();
-            });
-      }
-
-      if (segment_ptr->getState() == Segment::LoadState::Loading) {
-        return true;  // Segment is still loading
-      }
+  int priority = 0;
+  auto loadSegment = [&](auto &entry) {
+    auto &[n, segment_ptr] = entry;
+    if (!segment_ptr) {
+      segment_ptr = std::make_shared<Segment>(
+          n, route_.at(n), flags_, filters_,
+          [this](int seg_num, bool success) {
+            std::unique_lock lock(mutex_);
+            needs_update_ = true;
+            cv_.notify_one();
+          },
+          load_pool_, priority);
+    } else if (segment_ptr->getState() == Segment::LoadState::Loading ||
+               segment_ptr->getState() == Segment::LoadState::PartiallyLoaded) {
+      segment_ptr->setPriority(priority);  // the current segment has changed
     }
-    return false;  // No segments need loading
+    ++priority;
   };
 
-  // Try forward loading, then reverse if necessary
-  if (!tryLoadSegment(cur, end)) {
-    tryLoadSegment(std::make_reverse_iterator(cur), std::make_reverse_iterator(begin));
-  }
+  std::for_each(cur, end, loadSegment);
+  std::for_each(std::make_reverse_iterator(cur), std::make_reverse_iterator(begin), loadSegment);
 }
@@ -12,16 +12,38 @@ constexpr int MIN_SEGMENTS_CACHE = 5;
 
 using SegmentMap = std::map<int, std::shared_ptr<Segment>>;
 
+// Iterates the events of several sorted ranges in order, by a k-way merge
+class MergedEventIterator {
+public:
+  using Range = std::pair<const Event *, const Event *>;
+  // starts at the first event after the given one, and ends after the last one if given
+  MergedEventIterator(const std::vector<Range> &ranges, const Event &after, const Event *last = nullptr);
+  inline bool done() const { return heap_.empty(); }
+  inline const Event &operator*() const { return *heap_.front().first; }
+  MergedEventIterator &operator++();
+
+private:
+  static bool greater(const Range &a, const Range &b) { return *b.first < *a.first; }
+  std::vector<Range> heap_;  // min-heap of the non-empty ranges by their next event
+};
+
 class SegmentManager {
 public:
   struct EventData {
-    std::vector<Event> events;  //  Events extracted from the segments
+    std::vector<MergedEventIterator::Range> event_ranges;  // Sorted events of each segment, merged on iteration
     SegmentMap segments;        // Associated segments that contributed to these events
-    bool isSegmentLoaded(int n) const { return segments.find(n) != segments.end(); }
+    std::vector<std::shared_ptr<const std::vector<Event>>> segment_events;  // Keeps the ranges of partial segments alive
+    std::map<int, const Event *> partial_segments;  // Segments of which only the first seconds are merged, to their last event
+    std::set<int> loading_segments;  // Segments in the cache range that are not fully loaded yet
+    std::set<int> failed_segments;   // Segments in the cache range that failed to load
+    bool isSegmentLoaded(int n) const { return segments.count(n) > 0 && !isSegmentPartial(n); }
+    bool isSegmentPartial(int n) const { return partial_segments.count(n) > 0; }
+    bool isSegmentFailed(int n) const { return failed_segments.count(n) > 0; }
+    // the merged iteration stops at the last event of the first partial segment it reaches, until that one is loaded
+    const Event *iterationEnd(const Event &after) const;
   };
 
-  SegmentManager(const std::string &route_name, uint32_t flags, const std::string &data_dir = "")
-      : flags_(flags), route_(route_name, data_dir), event_data_(std::make_shared<EventData>()) {}
+  SegmentManager(const std::string &route_name, uint32_t flags, const std::string &data_dir = "");
   ~SegmentManager();
 
   bool load();
@@ -30,12 +52,14 @@ public:
   void setFilters(const std::vector<bool> &filters) { filters_ = filters; }
   const std::shared_ptr<EventData> getEventData() const { return std::atomic_load(&event_data_); }
   bool hasSegment(int n) const { return segments_.find(n) != segments_.end(); }
+  int lastSegment() const { return segments_.rbegin()->first; }
 
   Route route_;
   int segment_cache_limit_ = MIN_SEGMENTS_CACHE;
 
 private:
   void manageSegmentCache();
+  // loads all segments in the range, the current one first, then forward, then backward
   void loadSegmentsInRange(SegmentMap::iterator begin, SegmentMap::iterator cur, SegmentMap::iterator end);
   bool mergeSegments(const SegmentMap::iterator &begin, const SegmentMap::iterator &end);
 
@@ -49,8 +73,10 @@ private:
   bool needs_update_ = false;
   bool exit_ = false;
 
+  std::shared_ptr<SegmentLoadPool> load_pool_;
   SegmentMap segments_;
   std::shared_ptr<EventData> event_data_;
   std::function<void()> onSegmentMergedCallback_ = nullptr;
-  std::set<int> merged_segments_;
+  std::map<int, size_t> merged_segments_;  // segment -> merged event count
+  std::set<int> loading_segments_, failed_segments_;
 };
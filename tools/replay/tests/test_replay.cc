@@ -1,5 +1,8 @@
 #define CATCH_CONFIG_MAIN
+#include <zstd.h>
+
 #include "catch2/catch.hpp"
+#include "tools/replay/logcache.h"
 #include "tools/replay/replay.h"
 
 const std::string TEST_RLOG_URL = "https://commadataci.blob.core.windows.net/openpilotci/0c94aa1e1296d7c6/2021-05-05--19-48-37/0/rlog.bz2";
@@ -14,4 +17,171 @@ TEST_CASE("LogReader") {
     REQUIRE(log.load(corrupt_content.data(), corrupt_content.size()));
     REQUIRE(log.events.size() > 0);
   }
+
+  SECTION("memory mapped local log") {
+    std::string log_content = decompressBZ2(FileReader(true).read(TEST_RLOG_URL));
+    const std::string log_file = "/tmp/test_replay_rlog";
+    REQUIRE(util::write_file(log_file.c_str(), log_content.data(), log_content.size()) == 0);
+
+    std::vector<bool> filters(cereal::Event::Which::CAN + 1, false);
+    filters[cereal::Event::Which::CAN] = true;
+    LogReader log(filters), mapped_log(filters);
+    REQUIRE(log.load(log_content.data(), log_content.size()));
+    REQUIRE(mapped_log.load(log_file));
+    REQUIRE(mapped_log.events.size() == log.events.size());
+    for (size_t i = 0; i < log.events.size(); ++i) {
+      REQUIRE(mapped_log.events[i].which == cereal::Event::Which::CAN);
+      REQUIRE(mapped_log.events[i].data.asBytes() == log.events[i].data.asBytes());
+    }
+    std::remove(log_file.c_str());
+  }
+
+  SECTION("decompressed log cache") {
+    std::string log_content = FileReader(true).read(TEST_RLOG_URL);
+    const std::string cache_file = logCacheFilePath(log_content);
+    std::remove(cache_file.c_str());
+
+    LogReader log;
+    REQUIRE(log.load(TEST_RLOG_URL, nullptr, true));
+    REQUIRE(util::file_exists(cache_file));
+
+    std::vector<bool> filters(cereal::Event::Which::CAN + 1, false);
+    filters[cereal::Event::Which::CAN] = true;
+    LogReader cached_log, filtered_log(filters);
+    REQUIRE(cached_log.load(TEST_RLOG_URL, nullptr, true));
+    REQUIRE(filtered_log.load(TEST_RLOG_URL, nullptr, true));
+    REQUIRE(cached_log.events.size() == log.events.size());
+    for (size_t i = 0; i < log.events.size(); ++i) {
+      REQUIRE(cached_log.events[i].mono_time == log.events[i].mono_time);
+      REQUIRE(cached_log.events[i].data.asBytes() == log.events[i].data.asBytes());
+    }
+    auto can_count = std::count_if(log.events.begin(), log.events.end(), [](auto &e) { return e.which == cereal::Event::Which::CAN; });
+    REQUIRE(filtered_log.events.size() == can_count);
+  }
+
+  SECTION("streaming") {
+    LogReader log;
+    REQUIRE(log.load(TEST_RLOG_URL));
+
+    LogReader stream_log;
+    size_t callback_cnt = 0, prev_event_cnt = 0;
+    REQUIRE(stream_log.loadStreaming(TEST_RLOG_URL, [&](const std::vector<Event> &events) {
+      REQUIRE(events.size() >= prev_event_cnt);
+      prev_event_cnt = events.size();
+      ++callback_cnt;
+    }));
+    REQUIRE(callback_cnt > 1);
+    REQUIRE(stream_log.events.size() == log.events.size());
+    for (size_t i = 0; i < log.events.size(); ++i) {
+      REQUIRE(stream_log.events[i].mono_time == log.events[i].mono_time);
+      REQUIRE(stream_log.events[i].which == log.events[i].which);
+      REQUIRE(stream_log.events[i].data.asBytes() == log.events[i].data.asBytes());
+    }
+  }
+
+  SECTION("only the wanted frames of an indexed zstd log are decompressed") {
+    // a frame of can events and a frame of clocks events, followed by their index
+    std::string log_content, can_content;
+    std::vector<ZstdFrameIndexEntry> index;
+    for (auto which : {cereal::Event::Which::CAN, cereal::Event::Which::CLOCKS}) {
+      std::string frame;
+      ZstdFrameIndexEntry &entry = index.emplace_back();
+      for (int i = 0; i < 100; ++i) {
+        MessageBuilder msg;
+        auto evt = msg.initEvent();
+        evt.setLogMonoTime(index.size() * 1000 + i);
+        which == cereal::Event::Which::CAN ? (void)evt.initCan(1) : (void)evt.initClocks();
+        auto bytes = msg.toBytes();
+        frame.append((const char *)bytes.begin(), bytes.size());
+        entry.addWhich(which);
+        entry.min_mono_time = std::min<uint64_t>(entry.min_mono_time, evt.getLogMonoTime());
+        entry.max_mono_time = std::max<uint64_t>(entry.max_mono_time, evt.getLogMonoTime());
+      }
+      if (which == cereal::Event::Which::CAN) can_content = frame;
+
+      std::string compressed(ZSTD_compressBound(frame.size()), '\0');
+      compressed.resize(ZSTD_compress(compressed.data(), compressed.size(), frame.data(), frame.size(), 1));
+      if (which == cereal::Event::Which::CLOCKS) {
+        // corrupt the frame, it must not be decompressed
+        std::fill(compressed.begin() + 4, compressed.end(), (char)0xff);
+      }
+      entry.compressed_size = compressed.size();
+      entry.decompressed_size = frame.size();
+      log_content += compressed;
+    }
+    ZstdFrameIndexFooter footer = {.num_frames = (uint32_t)index.size()};
+    const uint32_t header[] = {ZSTD_SKIPPABLE_FRAME_MAGIC, uint32_t(index.size() * sizeof(ZstdFrameIndexEntry) + sizeof(footer))};
+    log_content.append((const char *)header, sizeof(header));
+    log_content.append((const char *)index.data(), index.size() * sizeof(ZstdFrameIndexEntry));
+    log_content.append((const char *)&footer, sizeof(footer));
+
+    const std::string log_file = "/tmp/test_replay_indexed_rlog.zst";
+    REQUIRE(util::write_file(log_file.c_str(), log_content.data(), log_content.size()) == 0);
+
+    std::vector<bool> filters(cereal::Event::Which::CAN + 1, false);
+    filters[cereal::Event::Which::CAN] = true;
+    LogReader can_log(filters), expected_log(filters);
+    REQUIRE(can_log.load(log_file));
+    REQUIRE(expected_log.load(can_content.data(), can_content.size()));
+    REQUIRE(can_log.events.size() == 100);
+    REQUIRE(can_log.events.size() == expected_log.events.size());
+    for (size_t i = 0; i < can_log.events.size(); ++i) {
+      REQUIRE(can_log.events[i].which == cereal::Event::Which::CAN);
+      REQUIRE(can_log.events[i].data.asBytes() == expected_log.events[i].data.asBytes());
+    }
+    std::remove(log_file.c_str());
+  }
+}
+
+std::vector<Event> makeEvents(const std::vector<uint64_t> &times) {
+  std::vector<Event> events;
+  for (uint64_t t : times) events.emplace_back(cereal::Event::Which::CAN, t, kj::ArrayPtr<const capnp::word>{});
+  return events;
+}
+
+TEST_CASE("MergedEventIterator") {
+  // the ranges overlap at the boundaries, like adjacent segments
+  auto a = makeEvents({1, 3, 5, 7}), b = makeEvents({6, 8, 9}), c = makeEvents({});
+  std::vector<MergedEventIterator::Range> ranges = {{a.data(), a.data() + a.size()},
+                                                    {b.data(), b.data() + b.size()},
+                                                    {c.data(), c.data() + c.size()}};
+
+  std::vector<uint64_t> merged;
+  for (MergedEventIterator it(ranges, Event(cereal::Event::Which::CAN, 3, {})); !it.done(); ++it) {
+    merged.push_back((*it).mono_time);
+  }
+  REQUIRE(merged == std::vector<uint64_t>{5, 6, 7, 8, 9});
+}
+
+TEST_CASE("MergedEventIterator stops at the end of a partial segment") {
+  // segment 0 is partially loaded, its first events are merged with the loaded segment 1
+  auto seg0 = makeEvents({1, 2, 3, 4, 5, 6, 7, 8}), seg1 = makeEvents({9, 10, 11});
+  const size_t partial_size = 3;
+
+  SegmentManager::EventData partial;
+  partial.event_ranges = {{seg0.data(), seg0.data() + partial_size}, {seg1.data(), seg1.data() + seg1.size()}};
+  partial.segments = {{0, nullptr}, {1, nullptr}};
+  partial.partial_segments[0] = &seg0[partial_size - 1];
+  REQUIRE_FALSE(partial.isSegmentLoaded(0));
+  REQUIRE(partial.isSegmentLoaded(1));
+
+  // streams as the stream thread does, from the last published event
+  std::vector<uint64_t> published;
+  Event cur(cereal::Event::Which::INIT_DATA, 0, {});
+  auto stream = [&](const SegmentManager::EventData &event_data) {
+    for (MergedEventIterator it(event_data.event_ranges, cur, event_data.iterationEnd(cur)); !it.done(); ++it) {
+      published.push_back((*it).mono_time);
+      cur = *it;
+    }
+  };
+  stream(partial);
+  REQUIRE(published == std::vector<uint64_t>{1, 2, 3});
+  // waits there until the segment is loaded
+  stream(partial);
+  REQUIRE(published.size() == partial_size);
+
+  SegmentManager::EventData loaded;
+  loaded.event_ranges = {{seg0.data(), seg0.data() + seg0.size()}, {seg1.data(), seg1.data() + seg1.size()}};
+  stream(loaded);
+  REQUIRE(published == std::vector<uint64_t>{1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11});
 }
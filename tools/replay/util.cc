@@ -2,7 +2,11 @@
 
 #include <bzlib.h>
 #include <curl/curl.h>
+#include <fcntl.h>
 #include <openssl/sha.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <cassert>
 #include <algorithm>
@@ -90,6 +94,19 @@ size_t write_cb(char *data, size_t size, size_t count, void *userp) {
   return w->write(data, size, count);
 }
 
+struct StreamWriter {
+  const std::function<bool(const char *, size_t)> *callback;
+  size_t written = 0;
+};
+
+size_t stream_write_cb(char *data, size_t size, size_t count, void *userp) {
+  auto w = (StreamWriter *)userp;
+  if (!(*w->callback)(data, size * count)) return 0;  // abort the transfer
+
+  w->written += size * count;
+  return size * count;
+}
+
 size_t dumy_write_cb(char *data, size_t size, size_t count, void *userp) { return size * count; }
 
 struct DownloadStats {
@@ -269,6 +286,68 @@ std::string httpGet(const std::string &url, size_t chunk_size, std::atomic<bool>
   return httpDownload(url, result, chunk_size, size, abort) ? result : "";
 }
 
+bool httpGetStream(const std::string &url, const std::function<bool(const char *, size_t)> &callback, std::atomic<bool> *abort) {
+  size_t content_length = getRemoteFileSize(url, abort);
+  if (content_length == 0) return false;
+
+  download_stats.add(url, content_length);
+
+  StreamWriter writer = {.callback = &callback};
+  CURL *eh = curl_easy_init();
+  curl_easy_setopt(eh, CURLOPT_WRITEFUNCTION, stream_write_cb);
+  curl_easy_setopt(eh, CURLOPT_WRITEDATA, (void *)&writer);
+  curl_easy_setopt(eh, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(eh, CURLOPT_HTTPGET, 1);
+  curl_easy_setopt(eh, CURLOPT_NOSIGNAL, 1);
+  curl_easy_setopt(eh, CURLOPT_FOLLOWLOCATION, 1);
+
+  CURLM *cm = curl_multi_init();
+  curl_multi_add_handle(cm, eh);
+
+  int still_running = 1;
+  size_t prev_written = 0;
+  while (still_running > 0 && !(abort && *abort)) {
+    CURLMcode mc = curl_multi_perform(cm, &still_running);
+    if (mc != CURLM_OK) {
+      break;
+    }
+    if (still_running > 0) {
+      curl_multi_wait(cm, nullptr, 0, 1000, nullptr);
+    }
+
+    if (((writer.written - prev_written) / (double)content_length) >= 0.01) {
+      download_stats.update(url, writer.written);
+      prev_written = writer.written;
+    }
+  }
+
+  bool success = false;
+  CURLMsg *msg;
+  int msgs_left = -1;
+  while ((msg = curl_multi_info_read(cm, &msgs_left)) && !(abort && *abort)) {
+    if (msg->msg == CURLMSG_DONE) {
+      if (msg->data.result == CURLE_OK) {
+        long res_status = 0;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &res_status);
+        success = res_status == 200 && writer.written == content_length;
+        if (!success) {
+          rWarning("Download failed: http error code: %d", res_status);
+        }
+      } else {
+        rWarning("Download failed: connection failure: %d", msg->data.result);
+      }
+    }
+  }
+
+  download_stats.update(url, writer.written, success);
+  download_stats.remove(url);
+
+  curl_multi_remove_handle(cm, eh);
+  curl_easy_cleanup(eh);
+  curl_multi_cleanup(cm);
+  return success;
+}
+
 bool httpDownload(const std::string &url, const std::string &file, size_t chunk_size, std::atomic<bool> *abort) {
   size_t size = getRemoteFileSize(url, abort);
   if (size == 0) return false;
@@ -362,6 +441,72 @@ std::string decompressZST(const std::byte *in, size_t in_size, std::atomic<bool>
   return {};
 }
 
+// Returns the frame index loggerd appends to zstd logs, or an empty vector if there is none
+std::vector<ZstdFrameIndexEntry> readZstdFrameIndex(const std::string &in) {
+  ZstdFrameIndexFooter footer;
+  if (in.size() < sizeof(footer)) return {};
+
+  memcpy(&footer, in.data() + in.size() - sizeof(footer), sizeof(footer));
+  if (footer.magic != ZSTD_FRAME_INDEX_MAGIC) return {};
+
+  uint32_t header[2];
+  const size_t index_size = (size_t)footer.num_frames * sizeof(ZstdFrameIndexEntry);
+  const size_t skippable_frame_size = sizeof(header) + index_size + sizeof(footer);
+  if (skippable_frame_size > in.size()) return {};
+
+  const char *frame = in.data() + in.size() - skippable_frame_size;
+  memcpy(header, frame, sizeof(header));
+  if (header[0] != ZSTD_SKIPPABLE_FRAME_MAGIC || header[1] != index_size + sizeof(footer)) return {};
+
+  std::vector<ZstdFrameIndexEntry> index(footer.num_frames);
+  memcpy(index.data(), frame + sizeof(header), index_size);
+
+  // the frames must exactly cover the data before the index
+  size_t compressed_size = std::accumulate(index.begin(), index.end(), size_t(0),
+                                           [](size_t sum, auto &f) { return sum + f.compressed_size; });
+  if (compressed_size + skippable_frame_size != in.size()) {
+    rWarning("zstd frame index doesn't match the log size");
+    return {};
+  }
+  return index;
+}
+
+// Decompresses only the independent frames accepted by select
+std::string decompressZSTFrames(const std::string &in, const std::vector<ZstdFrameIndexEntry> &index,
+                                const std::function<bool(const ZstdFrameIndexEntry &)> &select, std::atomic<bool> *abort) {
+  std::vector<bool> selected(index.size());
+  size_t out_size = 0;
+  for (size_t i = 0; i < index.size(); ++i) {
+    selected[i] = select(index[i]);
+    if (selected[i]) out_size += index[i].decompressed_size;
+  }
+
+  ZSTD_DCtx *dctx = ZSTD_createDCtx();
+  assert(dctx != nullptr);
+
+  std::string out(out_size, '\0');
+  size_t in_pos = 0, out_pos = 0;
+  for (size_t i = 0; i < index.size() && !(abort && *abort); ++i) {
+    if (selected[i]) {
+      size_t ret = ZSTD_decompressDCtx(dctx, out.data() + out_pos, index[i].decompressed_size,
+                                       in.data() + in_pos, index[i].compressed_size);
+      if (ZSTD_isError(ret) || ret != index[i].decompressed_size) {
+        rWarning("decompressZST error: frame %zu is corrupt", i);
+        break;
+      }
+      out_pos += ret;
+    }
+    in_pos += index[i].compressed_size;
+  }
+
+  ZSTD_freeDCtx(dctx);
+  if (!(abort && *abort)) {
+    out.resize(out_pos);
+    return out;
+  }
+  return {};
+}
+
 void precise_nano_sleep(int64_t nanoseconds, std::atomic<bool> &interrupt_requested) {
   struct timespec req, rem;
   req.tv_sec = nanoseconds / 1000000000;
@@ -432,3 +577,28 @@ MonotonicBuffer::~MonotonicBuffer() {
     free(buf);
   }
 }
+
+// MappedFile
+
+MappedFile::MappedFile(const std::string &file) {
+  int fd = HANDLE_EINTR(open(file.c_str(), O_RDONLY | O_CLOEXEC));
+  if (fd < 0) return;
+
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED) {
+      data_ = p;
+      size_ = st.st_size;
+    }
+  }
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (data_) munmap(data_, size_);
+}
+
+void MappedFile::advise(int advice) {
+  if (data_) madvise(data_, size_, advice);
+}
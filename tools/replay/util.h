@@ -8,6 +8,7 @@
 #include <string_view>
 #include <vector>
 #include "cereal/messaging/messaging.h"
+#include "system/loggerd/zstd_index.h"
 
 enum CameraType {
   RoadCam = 0,
@@ -46,15 +47,36 @@ private:
   static constexpr float growth_factor = 1.5;
 };
 
+// Read-only memory mapping of a local file
+class MappedFile {
+public:
+  MappedFile(const std::string &file);
+  ~MappedFile();
+  void advise(int advice);
+  inline bool valid() const { return data_ != nullptr; }
+  inline const char *data() const { return (const char *)data_; }
+  inline size_t size() const { return size_; }
+
+private:
+  void *data_ = nullptr;
+  size_t size_ = 0;
+};
+
 std::string sha256(const std::string &str);
 void precise_nano_sleep(int64_t nanoseconds, std::atomic<bool> &interrupt_requested);
 std::string decompressBZ2(const std::string &in, std::atomic<bool> *abort = nullptr);
 std::string decompressBZ2(const std::byte *in, size_t in_size, std::atomic<bool> *abort = nullptr);
 std::string decompressZST(const std::string &in, std::atomic<bool> *abort = nullptr);
 std::string decompressZST(const std::byte *in, size_t in_size, std::atomic<bool> *abort = nullptr);
+std::vector<ZstdFrameIndexEntry> readZstdFrameIndex(const std::string &in);
+std::string decompressZSTFrames(const std::string &in, const std::vector<ZstdFrameIndexEntry> &index,
+                                const std::function<bool(const ZstdFrameIndexEntry &)> &select, std::atomic<bool> *abort = nullptr);
 std::string getUrlWithoutQuery(const std::string &url);
 size_t getRemoteFileSize(const std::string &url, std::atomic<bool> *abort = nullptr);
 std::string httpGet(const std::string &url, size_t chunk_size = 0, std::atomic<bool> *abort = nullptr);
+// downloads over a single connection, passing the data to callback as it arrives. callback returns false to stop.
+bool httpGetStream(const std::string &url, const std::function<bool(const char *data, size_t size)> &callback,
+                   std::atomic<bool> *abort = nullptr);
 
 typedef std::function<void(uint64_t cur, uint64_t total, bool success)> DownloadProgressHandler;
 void installDownloadProgressHandler(DownloadProgressHandler);